@@ -24,9 +24,18 @@
 
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <klee/Internal/System/Time.h>
 #include <klee/Solver.h>
+#include <klee/util/ExprEvaluator.h>
+#include <klee/util/ExprPPrinter.h>
+#include <klee/util/ExprSMTLIBPrinter.h>
+#include <klee/util/ExprUtil.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <sys/resource.h>
+#include <sys/shm.h>
+#include <unistd.h>
 #include <s2e/ConfigFile.h>
 #include <s2e/Plugins/ExecutionTracers/TestCaseGenerator.h>
 #include <s2e/S2E.h>
@@ -68,6 +77,328 @@ public:
         return new TICooperatorState(*this);
     }
 };
+
+
+// stands for a symbolic index into the array
+const uint32_t ANY_BYTE = ~0u;
+
+// a branch belongs to a target when its pc is this close after ret_addr
+const uint64_t TARGET_WINDOW = 0x10;
+
+const char *const shapeNames[SHAPE_COUNT] = {
+    "single-byte-eq", "multi-byte-eq", "range", "arithmetic", "mul-div", "other",
+};
+
+// tree sizes saturate here, shared subtrees make them grow exponentially
+const uint64_t MAX_TREE_SIZE = 1ULL << 40;
+
+/**
+ * Depth and tree size of every node of a set of expression DAGs. The number
+ * of entries is the DAG's node count.
+ */
+struct ExprMeasure {
+    std::map<const Expr *, std::pair<unsigned, uint64_t>> nodes;
+
+    std::pair<unsigned, uint64_t> visit(const klee::ref<klee::Expr> &e) {
+        auto it = nodes.find(e.get());
+        if (it != nodes.end()) {
+            return it->second;
+        }
+
+        unsigned depth = 0;
+        uint64_t size = 1;
+        for (unsigned i = 0; i < e->getNumKids(); i++) {
+            auto kid = visit(e->getKid(i));
+            depth = std::max(depth, kid.first);
+            size = std::min(MAX_TREE_SIZE, size + kid.second);
+        }
+        return nodes[e.get()] = std::make_pair(depth + 1, size);
+    }
+};
+
+klee::ref<klee::Expr> replaceExpr(const klee::ref<klee::Expr> &e,
+                                  const Expr *target,
+                                  const klee::ref<klee::Expr> &value,
+                                  std::map<const Expr *, klee::ref<klee::Expr>> &memo) {
+    if (e.get() == target) {
+        return value;
+    }
+
+    auto it = memo.find(e.get());
+    if (it != memo.end()) {
+        return it->second;
+    }
+
+    klee::ref<klee::Expr> kids[8];
+    bool changed = false;
+    for (unsigned i = 0; i < e->getNumKids(); i++) {
+        kids[i] = replaceExpr(e->getKid(i), target, value, memo);
+        changed |= kids[i].get() != e->getKid(i).get();
+    }
+    return memo[e.get()] = changed ? e->rebuild(kids) : e;
+}
+
+void collectSymbolicBytes(const klee::ref<klee::Expr> &e, std::set<SymbolicByte> &bytes) {
+    std::vector<klee::ref<klee::ReadExpr>> reads;
+    klee::findReads(e, true, reads);
+    for (const auto &r : reads) {
+        auto ce = dyn_cast<ConstantExpr>(r->index);
+        bytes.emplace(r->updates.root, ce ? ce->getZExtValue() : ANY_BYTE);
+    }
+}
+
+bool sharesBytes(const std::set<SymbolicByte> &a, const std::set<SymbolicByte> &b) {
+    for (const auto &x : a) {
+        if (x.second == ANY_BYTE) {
+            // a symbolic index may read any byte of the array
+            auto it = b.lower_bound(SymbolicByte(x.first, 0));
+            if (it != b.end() && it->first == x.first) {
+                return true;
+            }
+        } else if (b.count(x) || b.count(SymbolicByte(x.first, ANY_BYTE))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void cachedSymbolicBytes(SymbolicBytesCache *cache, const klee::ref<klee::Expr> &e, std::set<SymbolicByte> &bytes) {
+    if (auto cached = cache->get(e)) {
+        bytes = *cached;
+    } else {
+        collectSymbolicBytes(e, bytes);
+        cache->put(e, bytes);
+    }
+}
+
+/// Collects the constraints that transitively share bytes with expr.
+/// Path constraints are immutable, so their byte sets are kept in cache
+/// across queries instead of walking the whole path every time.
+void sliceConstraints(const ConstraintManager &constraints,
+                      const klee::ref<klee::Expr> &expr,
+                      SymbolicBytesCache *cache,
+                      std::vector<klee::ref<klee::Expr>> &slice,
+                      std::set<SymbolicByte> &bytes) {
+    std::vector<klee::ref<klee::Expr>> pending(constraints.begin(), constraints.end());
+    std::vector<std::set<SymbolicByte>> pendingBytes(pending.size());
+    for (unsigned i = 0; i < pending.size(); i++) {
+        cachedSymbolicBytes(cache, pending[i], pendingBytes[i]);
+    }
+
+    collectSymbolicBytes(expr, bytes);
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (unsigned i = 0; i < pending.size();) {
+            if (!sharesBytes(pendingBytes[i], bytes)) {
+                i++;
+                continue;
+            }
+
+            slice.push_back(pending[i]);
+            bytes.insert(pendingBytes[i].begin(), pendingBytes[i].end());
+            pending[i] = pending.back();
+            pending.pop_back();
+            pendingBytes[i].swap(pendingBytes.back());
+            pendingBytes.pop_back();
+            changed = true;
+        }
+    }
+}
+
+/**
+ * Byte independence partition of a growing path prefix, for the batch trie
+ * walk. Adding a constraint unions its bytes; mark/rollback back out of a
+ * trie branch. There is no path compression, so every union is a single
+ * parent write that rollback can undo.
+ */
+class BytePartition {
+    std::map<SymbolicByte, unsigned> m_ids;
+    std::vector<unsigned> m_parent;
+    std::vector<unsigned> m_size;
+    // ANY_BYTE id of the arrays read at a symbolic index
+    std::map<const Array *, unsigned> m_wild;
+
+    std::vector<std::pair<unsigned, unsigned>> m_unions;
+    std::vector<SymbolicByte> m_added;
+    std::vector<const Array *> m_wildAdded;
+
+    unsigned id(const SymbolicByte &b) {
+        auto it = m_ids.find(b);
+        if (it != m_ids.end()) {
+            return it->second;
+        }
+
+        unsigned n = m_parent.size();
+        m_ids[b] = n;
+        m_parent.push_back(n);
+        m_size.push_back(1);
+        m_added.push_back(b);
+
+        if (b.second == ANY_BYTE) {
+            // a symbolic index ties every byte of the array together
+            m_wild[b.first] = n;
+            m_wildAdded.push_back(b.first);
+            for (auto it = m_ids.lower_bound(SymbolicByte(b.first, 0));
+                 it != m_ids.end() && it->first.first == b.first; ++it) {
+                if (it->second != n) {
+                    unite(it->second, n);
+                }
+            }
+        } else {
+            auto wild = m_wild.find(b.first);
+            if (wild != m_wild.end()) {
+                unite(n, wild->second);
+            }
+        }
+        return n;
+    }
+
+    void unite(unsigned a, unsigned b) {
+        a = find(a);
+        b = find(b);
+        if (a == b) {
+            return;
+        }
+        if (m_size[a] > m_size[b]) {
+            std::swap(a, b);
+        }
+        m_parent[a] = b;
+        m_size[b] += m_size[a];
+        m_unions.emplace_back(a, b);
+    }
+
+public:
+    struct Mark {
+        size_t unions;
+        size_t added;
+        size_t wild;
+    };
+
+    static const unsigned NONE = ~0u;
+
+    unsigned find(unsigned n) const {
+        while (m_parent[n] != n) {
+            n = m_parent[n];
+        }
+        return n;
+    }
+
+    // joins the bytes of one constraint, returns one of their ids or NONE
+    unsigned add(const std::set<SymbolicByte> &bytes) {
+        unsigned first = NONE;
+        for (const auto &b : bytes) {
+            unsigned n = id(b);
+            if (first == NONE) {
+                first = n;
+            } else {
+                unite(first, n);
+            }
+        }
+        return first;
+    }
+
+    // roots of the components bytes would join, without joining them
+    void roots(const std::set<SymbolicByte> &bytes, std::set<unsigned> &out) const {
+        for (const auto &b : bytes) {
+            if (b.second == ANY_BYTE) {
+                for (auto it = m_ids.lower_bound(SymbolicByte(b.first, 0));
+                     it != m_ids.end() && it->first.first == b.first; ++it) {
+                    out.insert(find(it->second));
+                }
+                continue;
+            }
+
+            auto it = m_ids.find(b);
+            if (it != m_ids.end()) {
+                out.insert(find(it->second));
+            }
+            auto wild = m_wild.find(b.first);
+            if (wild != m_wild.end()) {
+                out.insert(find(wild->second));
+            }
+        }
+    }
+
+    Mark mark() const {
+        return {m_unions.size(), m_added.size(), m_wildAdded.size()};
+    }
+
+    void rollback(const Mark &m) {
+        while (m_unions.size() > m.unions) {
+            auto u = m_unions.back();
+            m_unions.pop_back();
+            m_parent[u.first] = u.first;
+            m_size[u.second] -= m_size[u.first];
+        }
+        while (m_wildAdded.size() > m.wild) {
+            m_wild.erase(m_wildAdded.back());
+            m_wildAdded.pop_back();
+        }
+        // ids are handed out in order, so the newest ones are at the back
+        while (m_added.size() > m.added) {
+            m_ids.erase(m_added.back());
+            m_added.pop_back();
+            m_parent.pop_back();
+            m_size.pop_back();
+        }
+    }
+};
+
+/**
+ * Evaluates expressions under a model without building an Assignment.
+ * ExprVisitor memoizes visited nodes, so one instance evaluating a whole path
+ * only pays once for the subtrees that the constraints share.
+ */
+class ModelEvaluator : public klee::ExprEvaluator {
+    std::map<const Array *, const std::vector<unsigned char> *> m_values;
+
+protected:
+    klee::ref<klee::Expr> getInitialValue(const Array &array, unsigned index) {
+        auto it = m_values.find(&array);
+        if (it == m_values.end() || index >= it->second->size()) {
+            return ConstantExpr::alloc(0, Expr::Int8);
+        }
+        return ConstantExpr::alloc((*it->second)[index], Expr::Int8);
+    }
+
+public:
+    ModelEvaluator(const ArrayVec &objects, const std::vector<std::vector<unsigned char>> &values) {
+        for (unsigned i = 0; i < objects.size() && i < values.size(); i++) {
+            m_values[objects[i]] = &values[i];
+        }
+    }
+
+    bool isTrue(const klee::ref<klee::Expr> &e) {
+        auto ce = dyn_cast<ConstantExpr>(apply(e));
+        return ce && ce->isTrue();
+    }
+};
+
+/// cmpId of a site TI knows nothing about (jump tables, symbolic addresses),
+/// one per pc so that feedback weighs each site on its own. The top bit keeps
+/// them apart from TI's cmpIds.
+unsigned siteCmpId(uint64_t pc) {
+    return 0x80000000u | unsigned((pc ^ (pc >> 31)) & 0x7fffffff);
+}
+
+/// Order-independent hash of a sliced query. Expr hashes cover array names,
+/// so the same query built by another S2E process hashes the same.
+uint64_t canonicalQueryHash(const std::vector<klee::ref<klee::Expr>> &slice, const klee::ref<klee::Expr> &expr) {
+    std::vector<unsigned> hashes;
+    for (const auto &c : slice) {
+        hashes.push_back(c->hash());
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.push_back(expr->hash());
+
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (auto v : hashes) {
+        h = (h ^ v) * 0x100000001b3ULL;
+    }
+    return h ^ (uint64_t(slice.size()) << 48);
+}
 }
 
 S2E_DEFINE_PLUGIN(TICooperator, "Describe what the plugin does here", "", );
@@ -77,7 +408,99 @@ TICooperator::TICooperator(S2E *s2e)
                     m_TestCaseGenerator(nullptr),
                     m_currentState(nullptr),
                     dirPath(""),
-                    statOfs(nullptr) { }
+                    statOfs(nullptr),
+                    m_checkpointWriter(nullptr),
+                    m_checkpointInterval(0),
+                    m_lastCheckpoint(0),
+                    m_queryCache(nullptr),
+                    m_queryCacheOfs(nullptr),
+                    m_solverTime(0),
+                    m_solverCalls(0),
+                    m_cacheSavedTime(0),
+                    m_targetsPool(nullptr),
+                    m_temporariesPool(nullptr),
+                    m_dictionaryPool(nullptr),
+                    m_edgeMapPool(nullptr),
+                    m_feedbackPool(nullptr),
+                    m_pipelinePool(nullptr),
+                    m_symbolicBytesPool(nullptr),
+                    m_symbolicBytesCache(nullptr),
+                    m_addressPolicy(ADDRESS_POLICY_NONE),
+                    m_addressMaxRange(0),
+                    m_addressWindow(0),
+                    m_addressEmitTestcases(false),
+                    m_addressBoundsPool(nullptr),
+                    m_addressBoundsCache(nullptr),
+                    m_symbolicAddresses(0),
+                    m_addressBoundsHits(0),
+                    m_jumpTargetBudget(0),
+                    m_jumpTargetsFound(0),
+                    m_maxComparisonLength(0),
+                    m_modeledComparisons(0),
+                    m_dictOfs(nullptr),
+                    m_solutionsPerTarget(1),
+                    m_divergencePolicy(DIVERGENCE_OFF),
+                    m_unsatCorePool(nullptr),
+                    m_unsatCores(nullptr),
+                    m_unsatCoreMinimize(0),
+                    m_unsatCoreCount(0),
+                    m_shapeRouting(true),
+                    m_cutoffPc(0),
+                    m_cutoffTime(0),
+                    m_costBudget(0),
+                    m_costWarmup(0),
+                    m_costExplore(0),
+                    m_costOfs(nullptr),
+                    m_overBudgetQueries(0),
+                    m_deferredQueries(0),
+                    m_pipeline(nullptr),
+                    m_testcaseId(0),
+                    m_startTime(0),
+                    m_statsInterval(0),
+                    m_lastSample(0),
+                    m_samplesOfs(nullptr),
+                    m_deadlineClock(DEADLINE_USER),
+                    m_deadlineReached(false),
+                    m_heatmapEnabled(false),
+                    m_minimizeTestcases(false),
+                    m_minimizeBudget(0),
+                    m_minimizedBytes(0),
+                    m_keptBytes(0),
+                    m_inPhase(false),
+                    m_scopeToPhase(false),
+                    m_solvingEnabled(true),
+                    m_testcasesEmitted(0),
+                    m_addressHookConnected(false),
+                    m_concretizeNonCritical(false),
+                    m_portfolioTimeout(0),
+                    m_portfolioUnknown(0),
+                    m_portfolioRejected(0),
+                    m_maxQueryNodes(0),
+                    m_maxQueryDepth(0),
+                    m_budgetFallback(FALLBACK_OPTIMISTIC),
+                    m_batchSolving(false),
+                    m_batchSize(0),
+                    m_batchInterval(0),
+                    m_lastBatchFlush(0),
+                    m_batchState(nullptr),
+                    m_batchPending(0),
+                    m_batchSeedBytes(0),
+                    m_batchPool(nullptr),
+                    m_batchConstraints(nullptr),
+                    m_batchFlushes(0),
+                    m_batchDuplicates(0),
+                    m_batchPrefixWalked(0),
+                    m_batchPrefixTotal(0),
+                    m_edgeStart(0),
+                    m_edgeEnd(0),
+                    m_edgePrevLoc(0),
+                    m_edgeShm(nullptr),
+                    m_edgeMapWritten(false),
+                    m_feedback(nullptr),
+                    m_feedbackInterval(0),
+                    m_lastFeedbackPoll(0),
+                    m_feedbackSkips(0),
+                    m_effort(1) { }
 
 unsigned int TICooperator::constraintsCount = 0;
 unsigned int TICooperator::solvedConstraints = 0;
@@ -89,16 +512,390 @@ void TICooperator::initialize() {
     initTestcaseDirectory();
     readSelectedRetAddr();
 
+    ConfigFile *cfg = s2e()->getConfig();
+
+    /**
+     * Every plugin-owned container is charged to a pool, capped by
+     * memoryLimits.<pool> in MB (0 is unlimited). Caches evict in LRU order
+     * to stay under their cap; the target sets are bounded by ret_addr and
+     * only reported, since dropping them would lose targets. The same goes
+     * for the dictionary, edge map, feedback and testcase pipeline queues.
+     */
+    auto memoryLimit = [&](const std::string &pool, int64_t def) -> uint64_t {
+        return cfg->getInt(getConfigKey() + ".memoryLimits." + pool, def) << 20;
+    };
+    m_targetsPool = m_memory.createPool("targets", memoryLimit("targets", 0));
+    m_temporariesPool = m_memory.createPool("temporaries", memoryLimit("temporaries", 0));
+    m_dictionaryPool = m_memory.createPool("dictionary", memoryLimit("dictionary", 0));
+    m_edgeMapPool = m_memory.createPool("edgeMap", memoryLimit("edgeMap", 0));
+    m_feedbackPool = m_memory.createPool("feedback", memoryLimit("feedback", 0));
+    m_pipelinePool = m_memory.createPool("pipeline", memoryLimit("pipeline", 0));
+    m_symbolicBytesPool = m_memory.createPool("symbolicBytes", memoryLimit("symbolicBytes", 64));
+    m_symbolicBytesCache = new SymbolicBytesCache(
+        m_symbolicBytesPool,
+        [](const klee::ref<klee::Expr> &, const std::set<SymbolicByte> &bytes) { return containerBytes(bytes); });
+    m_addressBoundsPool = m_memory.createPool("addressBounds", memoryLimit("addressBounds", 16));
+    m_addressBoundsCache = new AddressBoundsCache(
+        m_addressBoundsPool, [](const uint64_t &, const AddressBounds &) { return sizeof(uint64_t) + sizeof(AddressBounds); });
+
+    // unsat cores, indexed by branch condition
+    if (cfg->getBool(getConfigKey() + ".unsatCores", false)) {
+        m_unsatCorePool = m_memory.createPool("unsatCores", memoryLimit("unsatCores", 16));
+        m_unsatCores = new UnsatCoreStore(m_unsatCorePool,
+                                          [](const klee::ref<klee::Expr> &,
+                                             const std::vector<std::vector<klee::ref<klee::Expr>>> &cores) {
+                                              // the expressions themselves are shared with the path
+                                              uint64_t size = 0;
+                                              for (const auto &core : cores) {
+                                                  size += sizeof(core) + core.size() * sizeof(klee::ref<klee::Expr>);
+                                              }
+                                              return size;
+                                          });
+        m_unsatCoreMinimize = cfg->getInt(getConfigKey() + ".unsatCoreMinimize", 16);
+    }
+
+    /**
+     * Reset solved bytes the branch does not need back to the seed. Each
+     * byte costs one evaluation of the constraints that read it;
+     * minimizeBudget caps the bytes tried per model (0 is unlimited). Off by
+     * default, it changes the testcases a run emits.
+     */
+    m_minimizeTestcases = cfg->getBool(getConfigKey() + ".minimizeTestcases", false);
+    m_minimizeBudget = cfg->getInt(getConfigKey() + ".minimizeBudget", 0);
+
+    // route single-byte conditions to the byte fast path
+    m_shapeRouting = cfg->getBool(getConfigKey() + ".shapeRouting", true);
+
+    /**
+     * Predict each query's solve time from its slice before issuing it.
+     * Queries predicted over costBudget seconds are dumped for offline
+     * solving instead of stalling emulation; every costExplore-th of them
+     * is solved anyway, so the online fit sees expensive queries too.
+     */
+    m_costBudget = cfg->getDouble(getConfigKey() + ".costBudget", 0);
+    if (m_costBudget > 0) {
+        m_costWarmup = cfg->getInt(getConfigKey() + ".costWarmup", 32);
+        m_costExplore = cfg->getInt(getConfigKey() + ".costExplore", 16);
+        m_costOfs = new std::ofstream(s2e()->getOutputDirectory() + "/cost.stats", std::ios::out);
+        *m_costOfs << "predicted,actual,sat,constraints,nodes,bytes,muldiv,shift\n";
+        llvm::sys::fs::create_directories(s2e()->getOutputDirectory() + "/deferred");
+    }
+
+    /**
+     * Assemble and write testcases on testcaseThreads pipeline threads
+     * instead of the emulation thread. Both pipeline queues hold at most
+     * testcaseQueueSize testcases; a full queue stalls its producer.
+     */
+    unsigned testcaseThreads = cfg->getInt(getConfigKey() + ".testcaseThreads", 0);
+    unsigned testcaseQueueSize = std::max<int64_t>(1, cfg->getInt(getConfigKey() + ".testcaseQueueSize", 64));
+
+    /**
+     * Write testcases straight into an AFL sync directory as
+     * <syncDirectory>/<syncName>/queue/id:NNNNNN,src:ticoop,ret:...,cmp:...
+     * for fuzzers running with -F or syncing from the same directory. Ids are
+     * shared by every S2E instance using the same syncName. syncInput names
+     * the symbolic file to emit when a testcase has several.
+     */
+    std::string syncDirectory = cfg->getString(getConfigKey() + ".syncDirectory", "");
+    if (!syncDirectory.empty()) {
+        auto sink = new AFLSyncSink(syncDirectory, cfg->getString(getConfigKey() + ".syncName", "ticoop"),
+                                    cfg->getString(getConfigKey() + ".syncInput", ""));
+        if (!sink->open()) {
+            getWarningsStream() << "unable to open AFL sync directory " << syncDirectory << "\n";
+            exit(-1);
+        }
+        s2e()->getDebugStream() << "TICooperator: writing testcases to " << sink->queueDirectory() << "\n";
+        m_pipeline = new TestcasePipeline(sink, std::max(1u, testcaseThreads), testcaseQueueSize);
+    } else if (testcaseThreads) {
+        m_pipeline = new TestcasePipeline(new DirectorySink(dirPath), testcaseThreads, testcaseQueueSize);
+    }
+
+    /**
+     * With scopeToPhase, targets are only evaluated inside the
+     * input-processing phase, which starts at any of phaseBegin and ends at
+     * any of phaseEnd (guest pcs), or is marked by the guest with
+     * TICOOP_PHASE_BEGIN / TICOOP_PHASE_END. This skips the forks of
+     * startup and output formatting.
+     */
+    m_scopeToPhase = cfg->getBool(getConfigKey() + ".scopeToPhase", false);
+    m_solvingEnabled = !m_scopeToPhase;
+    for (auto pc : cfg->getIntegerList(getConfigKey() + ".phaseBegin")) {
+        m_phaseBeginPcs.insert(pc);
+    }
+    for (auto pc : cfg->getIntegerList(getConfigKey() + ".phaseEnd")) {
+        m_phaseEndPcs.insert(pc);
+    }
+    if (!m_phaseBeginPcs.empty() || !m_phaseEndPcs.empty()) {
+        s2e()->getCorePlugin()->onTranslateInstructionStart.connect(
+            sigc::mem_fun(*this, &TICooperator::onPhaseTranslate));
+    }
+
+    /**
+     * Input bytes no pending target depends on only grow expressions and
+     * path constraints. With a criticalBytes file from TI, one
+     * "<ret_addr> <array> <offset> ..." line per target and symbolic object,
+     * every other byte is pinned to its concolic value the first time it
+     * shows up in a fork condition; klee substitutes the equality into the
+     * existing constraints and simplifies later expressions with it.
+     */
+    std::string criticalBytes = cfg->getString(getConfigKey() + ".criticalBytes", "");
+    if (!criticalBytes.empty()) {
+        readCriticalBytes(criticalBytes);
+        m_concretizeNonCritical = true;
+    }
+
+    /**
+     * portfolio maps names to solver command lines that take an SMT-LIB file
+     * as last argument, e.g. z3 = "z3 -smt2", boolector = "boolector -m".
+     * Every solver query is raced on all of them alongside S2E's solver. A
+     * model from S2E's solver ends the race; without one, the backends get
+     * up to portfolioTimeout more seconds (0 takes only answers already in).
+     * Wins are recorded per branch shape, "s2e" for S2E's solver.
+     */
+    for (const auto &name : cfg->getListKeys(getConfigKey() + ".portfolio")) {
+        m_portfolio.addBackend(name, cfg->getString(getConfigKey() + ".portfolio." + name));
+    }
+    m_portfolioTimeout = cfg->getDouble(getConfigKey() + ".portfolioTimeout", 0);
+
+    // expression budgets of a branch query (condition plus slice)
+    m_maxQueryNodes = cfg->getInt(getConfigKey() + ".maxQueryNodes", 0);
+    m_maxQueryDepth = cfg->getInt(getConfigKey() + ".maxQueryDepth", 0);
+    std::string budgetFallback = cfg->getString(getConfigKey() + ".queryBudgetFallback", "optimistic");
+    if (budgetFallback == "optimistic") {
+        m_budgetFallback = FALLBACK_OPTIMISTIC;
+    } else if (budgetFallback == "concretize") {
+        m_budgetFallback = FALLBACK_CONCRETIZE;
+    } else if (budgetFallback == "dump") {
+        m_budgetFallback = FALLBACK_DUMP;
+        llvm::sys::fs::create_directories(s2e()->getOutputDirectory() + "/deferred");
+    } else {
+        getWarningsStream() << "unknown queryBudgetFallback " << budgetFallback << "\n";
+        exit(-1);
+    }
+
+    /**
+     * With batchSolving, fork-decide queries are only recorded, in a trie
+     * keyed by the path constraints they were raised under. Every
+     * batchInterval seconds, after batchSize queries, and when the state
+     * dies, the trie is walked once: each prefix constraint joins the byte
+     * independence partition once, and every query is solved against the
+     * slice the partition gives for it instead of re-slicing its whole path.
+     */
+    m_batchSolving = cfg->getBool(getConfigKey() + ".batchSolving", false);
+    m_batchSize = cfg->getInt(getConfigKey() + ".batchSize", 0);
+    m_batchInterval = cfg->getDouble(getConfigKey() + ".batchInterval", 5);
+    if (m_batchSolving) {
+        m_batchPool = m_memory.createPool("batch", memoryLimit("batch", 0));
+        m_batchTrie.resize(1);
+        m_lastBatchFlush = klee::util::getWallTime();
+    }
+
+    /**
+     * AFL edge bitmap of the concolic path through [edgeStart, edgeEnd),
+     * hashed like afl-qemu so that it lines up with the fuzzer's own maps
+     * of a non-PIE target. It is written to edges.bitmap when the state
+     * dies, and copied into the SysV segment edgeBitmapShm when set, which
+     * tells the fuzzer what the TI seed actually explored.
+     */
+    if (cfg->getBool(getConfigKey() + ".edgeBitmap", false)) {
+        uint64_t mapSize = cfg->getInt(getConfigKey() + ".edgeMapSize", 1 << 16);
+        if (!mapSize || (mapSize & (mapSize - 1))) {
+            getWarningsStream() << "edgeMapSize must be a power of two\n";
+            exit(-1);
+        }
+        m_edgeMap.resize(mapSize);
+        m_edgeStart = cfg->getInt(getConfigKey() + ".edgeStart", 0);
+        m_edgeEnd = cfg->getInt(getConfigKey() + ".edgeEnd", ~0ull);
+
+        int shmId = cfg->getInt(getConfigKey() + ".edgeBitmapShm", -1);
+        if (shmId >= 0) {
+            void *shm = shmat(shmId, nullptr, 0);
+            if (shm == (void *) -1) {
+                getWarningsStream() << "TICooperator: could not attach edge bitmap segment " << shmId << "\n";
+            } else {
+                m_edgeShm = static_cast<uint8_t *>(shm);
+            }
+        }
+
+        s2e()->getCorePlugin()->onTranslateBlockStart.connect(sigc::mem_fun(*this, &TICooperator::onEdgeTranslate));
+    }
+
+    /**
+     * feedbackFile is where the fuzzer lists the TICooperator testcases that
+     * gave it new coverage (see TICooperatorFeedback.h), polled every
+     * feedbackInterval seconds. A target's weight, its payoff rate over the
+     * campaign's, scales its solutions and solver time budgets; targets
+     * below 1 are only solved on every 1/weight-th hit. The counts persist
+     * in feedbackState, next to ret_addr like the checkpoint, and are saved
+     * with every checkpoint so that a crash does not lose them. Jump table
+     * and symbolic address testcases get one cmpId per site.
+     */
+    std::string feedbackFile = cfg->getString(getConfigKey() + ".feedbackFile", "");
+    if (!feedbackFile.empty()) {
+        std::string feedbackState = cfg->getString(getConfigKey() + ".feedbackState", "ticoop.feedback");
+        m_feedback =
+            new FuzzerFeedback(feedbackFile, feedbackState, cfg->getDouble(getConfigKey() + ".feedbackPrior", 8));
+        m_feedback->load();
+        m_feedback->poll();
+        m_feedbackInterval = cfg->getDouble(getConfigKey() + ".feedbackInterval", 10);
+        m_lastFeedbackPoll = klee::util::getWallTime();
+    }
+
+    s2e()->getCorePlugin()->onStateKill.connect(sigc::mem_fun(*this, &TICooperator::onStateKill));
+
+    /**
+     * Once the trace passes the last point that can still reach an unstepped
+     * target, the rest of the run (objdump's output phase) is wasted
+     * emulation. Markers come from TI or a static CFG pass, one per line:
+     *
+     *   <marker pc> [<ret_addr reachable from it> ...]
+     *
+     * A marker without targets is past every target. Reaching a marker whose
+     * targets are all stepped ends the state.
+     */
+    std::string cutoffMarkers = cfg->getString(getConfigKey() + ".cutoffMarkers", "");
+    if (!cutoffMarkers.empty()) {
+        readCutoffMarkers(cutoffMarkers);
+        if (!m_cutoffMarkers.empty()) {
+            s2e()->getCorePlugin()->onTranslateInstructionStart.connect(
+                sigc::mem_fun(*this, &TICooperator::onCutoffTranslate));
+        }
+    }
+
+    /**
+     * Periodically snapshot plugin state, so that a crashed S2E or solver does
+     * not throw away the solving work already done. The snapshot lives next to
+     * ret_addr rather than in the per-run output directory, since the next run
+     * gets a fresh s2e-out-N.
+     */
+    m_checkpointFile = cfg->getString(getConfigKey() + ".checkpointFile", "ticoop.ckpt");
+    m_checkpointInterval = cfg->getInt(getConfigKey() + ".checkpointInterval", 0);
+    if (cfg->getBool(getConfigKey() + ".resume", false)) {
+        loadCheckpoint();
+    }
+    if (m_checkpointInterval > 0) {
+        m_checkpointWriter = new CheckpointWriter(m_checkpointFile);
+        m_lastCheckpoint = klee::util::getWallTime();
+    }
+
+    // query cache shared by all seeds of a campaign, disabled when empty
+    std::string queryCacheFile = cfg->getString(getConfigKey() + ".queryCacheFile", "");
+    if (!queryCacheFile.empty()) {
+        uint64_t size = cfg->getInt(getConfigKey() + ".queryCacheSize", 256) << 20;
+        m_queryCache = new PersistentQueryCache(queryCacheFile, size);
+        if (!m_queryCache->open()) {
+            s2e()->getWarningsStream() << "TICooperator: could not open query cache " << queryCacheFile << "\n";
+            delete m_queryCache;
+            m_queryCache = nullptr;
+        } else {
+            // own file, Solving.stats keeps its columns with or without a cache
+            m_queryCacheOfs = new std::ofstream(s2e()->getOutputDirectory() + "/querycache.stats", std::ios::out);
+            *m_queryCacheOfs << "user,hits,lookups,saved\n";
+        }
+    }
+
     std::string statsFilename = s2e()->getOutputDirectory() + "/Solving.stats";
     statOfs = new std::ofstream(statsFilename, std::ios::out);
-    
+
+    /**
+     * Stats are sampled every statsInterval seconds of wall time (0 samples
+     * on every timer tick). Besides the Solving.stats row, each sample
+     * records wall, user and system time, RSS and solver time in
+     * timing.stats, since user time alone hides I/O and solver waits.
+     */
+    m_startTime = klee::util::getWallTime();
+    m_statsInterval = cfg->getDouble(getConfigKey() + ".statsInterval", 0);
+    m_samplesOfs = new std::ofstream(s2e()->getOutputDirectory() + "/timing.stats", std::ios::out);
+    *m_samplesOfs << "wall,user,system,rssKB,solver,solved,unsolved,total\n";
+
+    // per input byte solver cost, rewritten on every stats sample
+    m_heatmapEnabled = cfg->getBool(getConfigKey() + ".heatmap", false);
+
     // use TestCaseGenerator
     m_TestCaseGenerator = s2e()->getPlugin<testcases::TestCaseGenerator>();
 
-    // for simple set fixed timeout 
-    m_timeout = 3600000;
+    // run deadline in seconds of user, user + system ("cpu") or wall time
+    m_timeout = cfg->getDouble(getConfigKey() + ".timeout", 3600000);
+    std::string deadlineClock = cfg->getString(getConfigKey() + ".timeoutClock", "user");
+    if (deadlineClock == "user") {
+        m_deadlineClock = DEADLINE_USER;
+    } else if (deadlineClock == "cpu") {
+        m_deadlineClock = DEADLINE_CPU;
+    } else if (deadlineClock == "wall") {
+        m_deadlineClock = DEADLINE_WALL;
+    } else {
+        getWarningsStream() << "unknown timeoutClock " << deadlineClock << "\n";
+        exit(-1);
+    }
     // for symbolic address
-    //s2e()->getCorePlugin()->onSymbolicAddress.connect(sigc::mem_fun(*this, &TICooperator::onSymbolicAddress));
+    std::string addressPolicy = cfg->getString(getConfigKey() + ".symbolicAddressPolicy", "none");
+    m_jumpTargetBudget = cfg->getInt(getConfigKey() + ".jumpTargetBudget", 0);
+    if (addressPolicy != "none") {
+        if (addressPolicy == "concolic") {
+            m_addressPolicy = ADDRESS_POLICY_CONCOLIC;
+        } else if (addressPolicy == "symbolic") {
+            m_addressPolicy = ADDRESS_POLICY_SYMBOLIC;
+        } else if (addressPolicy == "range") {
+            m_addressPolicy = ADDRESS_POLICY_RANGE;
+        } else {
+            getWarningsStream() << "unknown symbolicAddressPolicy " << addressPolicy << "\n";
+            exit(-1);
+        }
+
+        m_addressMaxRange = cfg->getInt(getConfigKey() + ".symbolicAddressMaxRange", 0x100);
+        m_addressWindow = cfg->getInt(getConfigKey() + ".symbolicAddressWindow", 0x1000);
+        m_addressEmitTestcases = cfg->getBool(getConfigKey() + ".symbolicAddressTestcases", true);
+    }
+
+    /**
+     * Comparison functions to model at TI target call sites, given as the
+     * addresses of the functions (or their PLT stubs) in the target binary,
+     * in the same per-address spirit as StaticFunctionModels:
+     *   comparisonModels = { memcmp = { 0x401030 }, strcmp = { 0x401040 } }
+     */
+    static const std::pair<const char *, ComparisonFunction> comparisonFunctions[] = {
+        {"memcmp", COMPARISON_MEMCMP},
+        {"strcmp", COMPARISON_STRCMP},
+        {"strncmp", COMPARISON_STRNCMP},
+    };
+    for (const auto &function : comparisonFunctions) {
+        auto key = getConfigKey() + ".comparisonModels." + function.first;
+        for (auto addr : cfg->getIntegerList(key)) {
+            m_comparisonModels[addr] = function.second;
+        }
+    }
+    m_maxComparisonLength = cfg->getInt(getConfigKey() + ".maxComparisonLength", 256);
+
+    m_solutionsPerTarget = std::max<int64_t>(1, cfg->getInt(getConfigKey() + ".solutionsPerTarget", 1));
+
+    // "off", "tag" (suffix diverging testcases) or "drop"; a model that
+    // misses the flipped branch itself is dropped under any policy
+    std::string divergence = cfg->getString(getConfigKey() + ".divergenceCheck", "off");
+    if (divergence == "off") {
+        m_divergencePolicy = DIVERGENCE_OFF;
+    } else if (divergence == "tag") {
+        m_divergencePolicy = DIVERGENCE_TAG;
+    } else if (divergence == "drop") {
+        m_divergencePolicy = DIVERGENCE_DROP;
+    } else {
+        getWarningsStream() << "unknown divergenceCheck " << divergence << "\n";
+        exit(-1);
+    }
+    if (!m_comparisonModels.empty()) {
+        m_dictOfs = new std::ofstream(s2e()->getOutputDirectory() + "/ticoop.dict", std::ios::out);
+
+        // tokens of a resumed checkpoint go into the fresh dictionary too
+        std::set<std::string> resumed;
+        resumed.swap(m_dictTokens);
+        for (const auto &token : resumed) {
+            addDictionaryToken(token);
+        }
+        s2e()->getCorePlugin()->onTranslateBlockEnd.connect(sigc::mem_fun(*this, &TICooperator::onTranslateBlockEnd));
+    }
+
+    if (m_addressPolicy != ADDRESS_POLICY_NONE || m_jumpTargetBudget) {
+        connectAddressHook();
+    }
 
     /**
      * For evaluating each branch condition calculated time in concolic path.
@@ -153,6 +950,26 @@ void TICooperator::initialize() {
 }   
 
 void TICooperator::onEngineShutdown() {
+    // a state still alive here is not safe to solve on anymore
+    if (m_batchPending) {
+        getWarningsStream() << "TICooperator: dropping " << m_batchPending << " batched queries at shutdown\n";
+        m_batchTrie.resize(1);
+        m_batchTrie[0] = BatchNode();
+        m_batchPending = 0;
+        m_batchSeed = nullptr;
+        m_batchSeedBytes = 0;
+        m_batchState = nullptr;
+    }
+
+    // finish pending testcases before anything reports on them
+    if (m_pipeline) {
+        m_pipeline->drain();
+        s2e()->getDebugStream() << "TICooperator: testcases written / duplicates / failed: " << m_pipeline->written()
+                                << " / " << m_pipeline->duplicates() << " / " << m_pipeline->failed() << "\n";
+        delete m_pipeline;
+        m_pipeline = nullptr;
+    }
+
     std::string failedStatsFilename = s2e()->getOutputDirectory() + "/failed.stats";
     std::ofstream failedOfs(failedStatsFilename, std::ios::out);
     unsigned int solvedBranch = 0, failedBranch = 0;
@@ -171,84 +988,465 @@ void TICooperator::onEngineShutdown() {
 
     failedOfs.close();
 
-    onTimer();
+    // testcases generated per target
+    std::ofstream solutionsOfs(s2e()->getOutputDirectory() + "/solutions.stats", std::ios::out);
+    for (const auto &it : m_solutionCounts) {
+        solutionsOfs << std::hex << it.first << " " << std::dec << retAddr[it.first] << " " << it.second << "\n";
+    }
+    solutionsOfs.close();
 
-    *statOfs << klee::util::getUserTime() << "," 
-             << solvedBranch << "," << failedBranch << "," << retAddr.size() << "\n";
-    statOfs->close();
-    delete statOfs;
-}
+    // shape, queries, answered by the fast path, total seconds, mean seconds
+    std::ofstream shapesOfs(s2e()->getOutputDirectory() + "/shapes.stats", std::ios::out);
+    for (unsigned i = 0; i < SHAPE_COUNT; i++) {
+        const auto &stats = m_shapeStats[i];
+        shapesOfs << shapeNames[i] << " " << stats.queries << " " << stats.fastPath << " " << stats.time << " "
+                  << (stats.queries ? stats.time / stats.queries : 0) << "\n";
+    }
+    shapesOfs.close();
 
-void TICooperator::onTimer() {
-    std::stringstream ss;
-    ss << solvedConstraints << "," << unsolvedConstraints << ","
-       << constraintsCount << "\n";
-    // update solvedConstraints / unsolvedConstraints / constraintsCount
-    s2e()->getDebugStream() << "TICooperator: solved / unsolved / total: "  << ss.str();
-    // write solvedConstraints / unsolvedConstraints / constraintsCount to file
-    // user time ???
-    *statOfs << klee::util::getUserTime() << "," << ss.str();
-    statOfs->flush();
+    // input-processing phases marked by the guest, wall seconds since start
+    if (!m_phases.empty()) {
+        std::ofstream phasesOfs(s2e()->getOutputDirectory() + "/phases.stats", std::ios::out);
+        for (const auto &phase : m_phases) {
+            phasesOfs << phase.first << " " << phase.second << "\n";
+        }
+        phasesOfs.close();
+    }
 
-    // terminate state when time limit is achived
-    if (klee::util::getUserTime() >= m_timeout)
-        s2e()->getExecutor()->terminateState(*m_currentState, "timeout");
-}
+    // shape, winning solver, wins
+    if (!m_portfolio.empty()) {
+        std::ofstream portfolioOfs(s2e()->getOutputDirectory() + "/portfolio.stats", std::ios::out);
+        for (unsigned i = 0; i < SHAPE_COUNT; i++) {
+            for (const auto &it : m_portfolioWins[i]) {
+                portfolioOfs << shapeNames[i] << " " << it.first << " " << it.second << "\n";
+            }
+        }
+        portfolioOfs << "unanswered " << m_portfolioUnknown << "\n";
+        portfolioOfs << "rejected " << m_portfolioRejected << "\n";
+        portfolioOfs.close();
+    }
 
-void TICooperator::onStateForkDecide(S2EExecutionState *state, 
-                                           const klee::ref<klee::Expr> &condition_, 
-                                           bool &allowForking) {
-    // always disable forking  
-    if (allowForking) {
-        allowForking = false;
+    // over-budget queries per target: optimistic, concretized, dumped
+    if (!m_budgetFallbacks.empty()) {
+        std::ofstream budgetOfs(s2e()->getOutputDirectory() + "/budget.stats", std::ios::out);
+        for (const auto &it : m_budgetFallbacks) {
+            budgetOfs << std::hex << it.first << " " << std::dec << (retAddr.count(it.first) ? retAddr[it.first] : 0)
+                      << " " << it.second[FALLBACK_OPTIMISTIC] << " " << it.second[FALLBACK_CONCRETIZE] << " "
+                      << it.second[FALLBACK_DUMP] << "\n";
+        }
+        budgetOfs.close();
     }
-     
-    if (m_currentState == nullptr)
-        m_currentState = static_cast<klee::ExecutionState *>(state);
 
-    assert(!state->isRunningConcrete());
-    auto condition = state->simplifyExpr(condition_);
+    // array, offset, pinned value, pc of the fork that first used the byte
+    if (m_concretizeNonCritical) {
+        std::ofstream concretizedOfs(s2e()->getOutputDirectory() + "/concretized.stats", std::ios::out);
+        for (const auto &it : m_concretized) {
+            concretizedOfs << it.first.first->getName() << " " << it.first.second << " "
+                           << unsigned(it.second.first) << " " << std::hex << it.second.second << std::dec << "\n";
+        }
+        concretizedOfs.close();
+    }
 
-    // If we are passed a constant, no need to do anything
-    if (auto ce = dyn_cast<ConstantExpr>(condition)) {
-        return;
+    // where and when the state was cut off, stepped / total targets
+    if (m_cutoffPc) {
+        std::ofstream cutoffOfs(s2e()->getOutputDirectory() + "/cutoff.stats", std::ios::out);
+        cutoffOfs << std::hex << m_cutoffPc << std::dec << " " << m_cutoffTime << " " << isStepped.size() << " "
+                  << retAddr.size() << "\n";
+        cutoffOfs.close();
     }
-    
-    // we have disabled state fork, therefore we need to collect
-    // new state fork branch condition and solve them manually.
-    // check if the cmp is we want
-    uint64_t currentPc = state->regs()->getPc(); 
-    auto it = std::find_if(retAddr.begin(), retAddr.end(), 
-        [&currentPc](const std::pair<uint64_t, unsigned int> &e) -> bool
-        {   
-            if (currentPc < e.first)
-              return false;
-
-            return ((currentPc - e.first) < 0x10);
-        }); 
-    
-    uint64_t ret_addr;
-    unsigned int cmpId;
-         
-    if (it == retAddr.end()) {
 
-        ret_addr = currentPc;
-        cmpId = 0;
+    // queries answered from the unsat core store, per target
+    if (m_unsatCores) {
+        std::ofstream coresOfs(s2e()->getOutputDirectory() + "/cores.stats", std::ios::out);
+        for (const auto &it : m_coreSkips) {
+            coresOfs << std::hex << it.first << " " << std::dec << (retAddr.count(it.first) ? retAddr[it.first] : 0)
+                     << " " << it.second << "\n";
+        }
+        coresOfs.close();
     }
-    else {
-        ret_addr = it->first;
-        cmpId = it->second;
+
+    // cmpId, checked models, diverging models, divergence rate
+    if (m_divergencePolicy != DIVERGENCE_OFF) {
+        std::ofstream divergenceOfs(s2e()->getOutputDirectory() + "/divergence.stats", std::ios::out);
+        for (const auto &it : m_divergence) {
+            divergenceOfs << it.first << " " << it.second.first << " " << it.second.second << " "
+                          << double(it.second.second) / it.second.first << "\n";
+        }
+        divergenceOfs.close();
     }
 
-    if (it == retAddr.end()) {
-      
-      return;
+    // flushes, distinct and duplicate queries, prefix constraints joined by
+    // the trie walks and by slicing every query on its own
+    if (m_batchSolving) {
+        std::ofstream batchOfs(s2e()->getOutputDirectory() + "/batch.stats", std::ios::out);
+        batchOfs << m_batchFlushes << " " << constraintsCount << " " << m_batchDuplicates << " "
+                 << m_batchPrefixWalked << " " << m_batchPrefixTotal << "\n";
+        batchOfs.close();
+    }
 
+    // the state was never killed, e.g. on a run deadline
+    if (!m_edgeMap.empty() && !m_edgeMapWritten) {
+        writeEdgeBitmap();
     }
-    else if (isStepped.find(it->first) == isStepped.end()) {
-        
-        isStepped.emplace(it->first);
-    
+    if (m_edgeShm) {
+        shmdt(m_edgeShm);
+        m_edgeShm = nullptr;
+    }
+
+    // cmpId, testcases emitted, productive in the fuzzer, current weight
+    if (m_feedback) {
+        m_feedback->poll();
+        if (!m_feedback->save()) {
+            getWarningsStream() << "TICooperator: could not save fuzzer feedback state\n";
+        }
+        std::ofstream feedbackOfs(s2e()->getOutputDirectory() + "/feedback.stats", std::ios::out);
+        for (const auto &it : m_feedback->payoff()) {
+            feedbackOfs << it.first << " " << it.second.emitted << " " << it.second.productive << " "
+                        << m_feedback->weight(it.first) << "\n";
+        }
+        feedbackOfs << "skipped " << m_feedbackSkips << "\n";
+        feedbackOfs.close();
+        delete m_feedback;
+        m_feedback = nullptr;
+    }
+
+    // final sample regardless of the interval
+    m_lastSample = 0;
+    onTimer();
+
+    *statOfs << klee::util::getUserTime() << "," 
+             << solvedBranch << "," << failedBranch << "," << retAddr.size() << "\n";
+    statOfs->close();
+    delete statOfs;
+
+    m_samplesOfs->close();
+    delete m_samplesOfs;
+    m_samplesOfs = nullptr;
+
+    if (m_checkpointWriter) {
+        saveCheckpoint(true);
+        delete m_checkpointWriter;
+        m_checkpointWriter = nullptr;
+    }
+
+    if (m_queryCacheOfs) {
+        m_queryCacheOfs->close();
+        delete m_queryCacheOfs;
+        m_queryCacheOfs = nullptr;
+    }
+    delete m_queryCache;
+    m_queryCache = nullptr;
+
+    delete m_symbolicBytesCache;
+    m_symbolicBytesCache = nullptr;
+
+    delete m_addressBoundsCache;
+    m_addressBoundsCache = nullptr;
+
+    delete m_unsatCores;
+    m_unsatCores = nullptr;
+
+    if (m_costOfs) {
+        m_costOfs->close();
+        delete m_costOfs;
+        m_costOfs = nullptr;
+    }
+
+    if (m_dictOfs) {
+        m_dictOfs->close();
+        delete m_dictOfs;
+        m_dictOfs = nullptr;
+    }
+}
+
+void TICooperator::onTimer() {
+    if (m_feedback && klee::util::getWallTime() - m_lastFeedbackPoll >= m_feedbackInterval) {
+        m_feedback->poll();
+        m_lastFeedbackPoll = klee::util::getWallTime();
+    }
+
+    if (m_batchPending && klee::util::getWallTime() - m_lastBatchFlush >= m_batchInterval) {
+        flushBatch();
+    }
+
+    if (klee::util::getWallTime() - m_lastSample >= m_statsInterval) {
+        sampleStats();
+        printStatistics();
+    }
+
+    if (m_checkpointWriter && klee::util::getWallTime() - m_lastCheckpoint >= m_checkpointInterval) {
+        saveCheckpoint(false);
+    }
+
+    checkDeadline();
+}
+
+// solved / unsolved / total
+std::string TICooperator::solvingCounters() const {
+    std::stringstream ss;
+    ss << solvedConstraints << "," << unsolvedConstraints << "," << constraintsCount << "\n";
+    return ss.str();
+}
+
+void TICooperator::printStatistics() {
+    s2e()->getDebugStream() << "TICooperator: solved / unsolved / total: " << solvingCounters();
+    if (m_queryCache) {
+        s2e()->getDebugStream() << "TICooperator: query cache hits / lookups / saved seconds: " << m_queryCache->hits()
+                                << " / " << m_queryCache->lookups() << " / " << m_cacheSavedTime << "\n";
+    }
+
+    if (m_symbolicAddresses) {
+        s2e()->getDebugStream() << "TICooperator: symbolic addresses / bounds cache hits: " << m_symbolicAddresses
+                                << " / " << m_addressBoundsHits << "\n";
+    }
+    if (m_unsatCores) {
+        unsigned skipped = 0;
+        for (const auto &it : m_coreSkips) {
+            skipped += it.second;
+        }
+        s2e()->getDebugStream() << "TICooperator: unsat cores / skipped queries: " << m_unsatCoreCount << " / "
+                                << skipped << "\n";
+    }
+    if (m_modeledComparisons) {
+        s2e()->getDebugStream() << "TICooperator: modeled comparisons / dictionary tokens: " << m_modeledComparisons
+                                << " / " << m_dictTokens.size() << "\n";
+    }
+    if (m_jumpTargetsFound) {
+        s2e()->getDebugStream() << "TICooperator: symbolic jumps / targets found: " << m_jumpTargets.size() << " / "
+                                << m_jumpTargetsFound << "\n";
+    }
+    if (m_pipeline) {
+        s2e()->getDebugStream() << "TICooperator: testcases submitted / written / duplicates: "
+                                << m_pipeline->submitted() << " / " << m_pipeline->written() << " / "
+                                << m_pipeline->duplicates() << ", stalls submit / write: "
+                                << m_pipeline->submitStalls() << " / " << m_pipeline->writeStalls() << "\n";
+    }
+    if (!m_concretized.empty()) {
+        s2e()->getDebugStream() << "TICooperator: non-critical bytes concretized: " << m_concretized.size() << "\n";
+    }
+    if (m_minimizedBytes) {
+        s2e()->getDebugStream() << "TICooperator: bytes reset to seed / kept: " << m_minimizedBytes << " / "
+                                << m_keptBytes << "\n";
+    }
+    if (m_deferredQueries) {
+        s2e()->getDebugStream() << "TICooperator: queries deferred by cost prediction: " << m_deferredQueries << "\n";
+    }
+    if (m_shapeStats[SHAPE_SINGLE_BYTE_EQ].fastPath || m_shapeStats[SHAPE_RANGE].fastPath) {
+        s2e()->getDebugStream() << "TICooperator: byte fast path: "
+                                << m_shapeStats[SHAPE_SINGLE_BYTE_EQ].fastPath + m_shapeStats[SHAPE_RANGE].fastPath
+                                << "\n";
+    }
+
+    reportMemory();
+}
+
+void TICooperator::sampleStats() {
+    double now = klee::util::getWallTime();
+    m_lastSample = now;
+
+    // write solvedConstraints / unsolvedConstraints / constraintsCount to file
+    *statOfs << klee::util::getUserTime() << "," << solvingCounters();
+    statOfs->flush();
+
+    if (m_queryCacheOfs) {
+        *m_queryCacheOfs << klee::util::getUserTime() << "," << m_queryCache->hits() << "," << m_queryCache->lookups()
+                         << "," << m_cacheSavedTime << "\n";
+        m_queryCacheOfs->flush();
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double user = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    double system = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    // resident pages are the second field of statm
+    uint64_t pages = 0, rss = 0;
+    std::ifstream statm("/proc/self/statm");
+    if (statm >> pages >> rss) {
+        rss = rss * sysconf(_SC_PAGESIZE) / 1024;
+    }
+
+    if (m_heatmapEnabled) {
+        writeHeatmap();
+    }
+
+    *m_samplesOfs << now - m_startTime << "," << user << "," << system << "," << rss << "," << m_solverTime << ","
+                  << solvedConstraints << "," << unsolvedConstraints << "," << constraintsCount << "\n";
+    m_samplesOfs->flush();
+}
+
+// terminate state when time limit is achived
+void TICooperator::checkDeadline() {
+    double elapsed;
+    const char *clock;
+    switch (m_deadlineClock) {
+        case DEADLINE_CPU: {
+            struct rusage usage;
+            getrusage(RUSAGE_SELF, &usage);
+            elapsed = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec +
+                      usage.ru_stime.tv_usec / 1e6;
+            clock = "cpu";
+            break;
+        }
+        case DEADLINE_WALL:
+            elapsed = klee::util::getWallTime() - m_startTime;
+            clock = "wall";
+            break;
+        default:
+            elapsed = klee::util::getUserTime();
+            clock = "user";
+            break;
+    }
+
+    // terminate once, the timer keeps ticking after the state is gone
+    if (elapsed >= m_timeout && m_currentState && !m_deadlineReached) {
+        m_deadlineReached = true;
+        klee::ExecutionState *state = m_currentState;
+        m_currentState = nullptr;
+        s2e()->getExecutor()->terminateState(*state, std::string("timeout (") + clock + " time)");
+    }
+}
+
+void TICooperator::reportMemory() {
+    uint64_t targets = containerBytes(retAddr) + containerBytes(isStepped) + containerBytes(m_resumedTargets) +
+                       containerBytes(m_solutionCounts) + containerBytes(m_divergence) + containerBytes(m_coreSkips) +
+                       containerBytes(m_heatmap) + containerBytes(m_concretized);
+    for (const auto &it : m_jumpTargets) {
+        targets += containerBytes(it.second) + sizeof(it);
+    }
+    targets += containerBytes(m_modeledTargets) + containerBytes(m_exhaustedJumps) + containerBytes(m_budgetFallbacks) + containerBytes(m_feedbackSeen) +
+               containerBytes(m_cutoffMarkers) + containerBytes(m_criticalBytes) + containerBytes(m_disabledRegions) +
+               containerBytes(m_phaseBeginPcs) + containerBytes(m_phaseEndPcs) + containerBytes(m_phases);
+    for (const auto &it : m_cutoffMarkers) {
+        targets += it.second.size() * sizeof(uint64_t);
+    }
+    for (const auto &it : m_criticalBytes) {
+        targets += it.first.first.size() + it.second.size() * sizeof(uint64_t);
+    }
+    m_targetsPool->set(targets);
+
+    uint64_t dictionary = containerBytes(m_dictTokens);
+    for (const auto &token : m_dictTokens) {
+        dictionary += token.size();
+    }
+    m_dictionaryPool->set(dictionary);
+
+    m_edgeMapPool->set(m_edgeMap.size());
+    m_feedbackPool->set(m_feedback ? m_feedback->memoryBytes() : 0);
+    m_pipelinePool->set(m_pipeline ? m_pipeline->memoryBytes() : 0);
+
+    auto &os = s2e()->getDebugStream();
+    os << "TICooperator: memory current / peak: " << m_memory.current() << " / " << m_memory.peak() << "\n";
+    for (const auto &pool : m_memory.pools()) {
+        os << "TICooperator:   " << pool->name() << " " << pool->current() << " / " << pool->peak();
+        if (pool->limit()) {
+            os << " (limit " << pool->limit() << ")";
+        }
+        os << "\n";
+
+        if (pool->overLimit() && !m_memoryWarned.count(pool->name())) {
+            s2e()->getWarningsStream() << "TICooperator: " << pool->name() << " exceeds its memory limit\n";
+            m_memoryWarned.insert(pool->name());
+        }
+    }
+    os << "TICooperator:   symbolicBytes evictions " << m_symbolicBytesCache->evictions() << "\n";
+    os << "TICooperator:   addressBounds evictions " << m_addressBoundsCache->evictions() << "\n";
+    if (m_unsatCores) {
+        os << "TICooperator:   unsatCores evictions " << m_unsatCores->evictions() << "\n";
+    }
+}
+
+/// Returns the target whose ret_addr is the closest one at most 0x10 bytes
+/// before pc, or retAddr.end().
+std::map<uint64_t, unsigned int>::iterator TICooperator::findTarget(uint64_t pc) {
+    // the last ret_addr not after pc
+    auto it = retAddr.upper_bound(pc);
+    if (it == retAddr.begin()) {
+        return retAddr.end();
+    }
+    --it;
+    if (pc - it->first >= TARGET_WINDOW) {
+        return retAddr.end();
+    }
+    return it;
+}
+
+void TICooperator::onStateForkDecide(S2EExecutionState *state, 
+                                           const klee::ref<klee::Expr> &condition_, 
+                                           bool &allowForking) {
+    // always disable forking  
+    if (allowForking) {
+        allowForking = false;
+    }
+
+    if (m_currentState == nullptr)
+        m_currentState = static_cast<klee::ExecutionState *>(state);
+
+    // outside the input-processing phase
+    if (!m_solvingEnabled) {
+        return;
+    }
+
+    assert(!state->isRunningConcrete());
+    auto condition = state->simplifyExpr(condition_);
+
+    if (m_concretizeNonCritical && !isa<ConstantExpr>(condition)) {
+        condition = concretizeNonCritical(state, condition);
+    }
+
+    // If we are passed a constant, no need to do anything
+    if (auto ce = dyn_cast<ConstantExpr>(condition)) {
+        return;
+    }
+    
+    // we have disabled state fork, therefore we need to collect
+    // new state fork branch condition and solve them manually.
+    // check if the cmp is we want
+    uint64_t currentPc = state->regs()->getPc(); 
+    if (!m_disabledRegions.empty() && inDisabledRegion(currentPc)) {
+        return;
+    }
+    auto it = findTarget(currentPc);
+    
+    uint64_t ret_addr;
+    unsigned int cmpId;
+         
+    if (it == retAddr.end()) {
+
+        ret_addr = currentPc;
+        cmpId = 0;
+    }
+    else {
+        ret_addr = it->first;
+        cmpId = it->second;
+    }
+
+    if (it == retAddr.end()) {
+      
+      return;
+
+    }
+    else if (m_resumedTargets.count(it->first)) {
+        // already solved before the previous run went down
+        return;
+    }
+    else if (m_modeledTargets.count(it->first)) {
+        // the test of the comparison's result, solved at the call already
+        return;
+    }
+
+    // low-payoff targets are only solved on every 1/weight-th hit, the
+    // skipped hits must not mark the target stepped
+    double weight = m_feedback ? m_feedback->weight(cmpId) : 1;
+    if (weight < 1 && m_feedbackSeen[cmpId]++ % unsigned(1 / weight + 0.5)) {
+        m_feedbackSkips++;
+        return;
+    }
+
+    if (isStepped.find(it->first) == isStepped.end()) {
+        
+        isStepped.emplace(it->first);
+    
     }
 
     // Evaluate the expression using the current variable assignment
@@ -257,152 +1455,2274 @@ void TICooperator::onStateForkDecide(S2EExecutionState *state,
     check(ce, "Could not evaluate the expression to a constant.");
     bool conditionIsTrue = ce->isTrue();
 
-    // Build constraints for branched state
-    ConstraintManager tmpConstraints = state->constraints();
-    if (conditionIsTrue) {
-        tmpConstraints.addConstraint(Expr::createIsZero(condition));
+    // Build constraint for branched state
+    klee::ref<klee::Expr> branchCondition = conditionIsTrue ? Expr::createIsZero(condition) : condition;
+
+    if (m_batchSolving) {
+        enqueueBatch(state, branchCondition, ret_addr, cmpId);
+        return;
+    }
+
+    std::vector<klee::ref<klee::Expr>> slice;
+    std::set<SymbolicByte> bytes;
+    sliceConstraints(state->constraints(), branchCondition, m_symbolicBytesCache, slice, bytes);
+    processBranch(state, branchCondition, slice, bytes, ret_addr, cmpId);
+
+    /*if (isStepped.size() == retAddr.size())
+        s2e()->getExecutor()->terminateState(*m_currentState, "all requested inst. stepped");*/
+
+}
+
+const ConstraintManager &TICooperator::pathConstraints(S2EExecutionState *state) const {
+    return m_batchConstraints ? *m_batchConstraints : state->constraints();
+}
+
+/**
+ * Record a query under the current path. The forks of one path raise their
+ * queries under ever longer prefixes of the same constraints, so the trie is
+ * mostly a single chain, with side branches where klee rewrote earlier
+ * constraints after learning an equality.
+ */
+void TICooperator::enqueueBatch(S2EExecutionState *state,
+                                const klee::ref<klee::Expr> &branchCondition,
+                                uint64_t ret_addr,
+                                unsigned int cmpId) {
+    if (m_batchState && m_batchState != state) {
+        flushBatch();
+    }
+    m_batchState = state;
+
+    unsigned node = 0;
+    for (const auto &c : state->constraints()) {
+        unsigned next = 0;
+        for (auto child : m_batchTrie[node].children) {
+            if (m_batchTrie[child].constraint == c) {
+                next = child;
+                break;
+            }
+        }
+
+        if (!next) {
+            next = m_batchTrie.size();
+            m_batchTrie.emplace_back();
+            m_batchTrie[next].constraint = c;
+            m_batchTrie[node].children.push_back(next);
+        }
+        node = next;
+    }
+
+    auto &queries = m_batchTrie[node].queries;
+    for (const auto &q : queries) {
+        if (q.condition == branchCondition) {
+            m_batchDuplicates++;
+            return;
+        }
+    }
+
+    // the state keeps running until the flush, snapshot what it may change
+    if (!m_batchSeed || m_batchSeed->bindings != state->concolics->bindings) {
+        m_batchSeed = std::make_shared<klee::Assignment>(*state->concolics);
+        for (const auto &it : m_batchSeed->bindings) {
+            m_batchSeedBytes += it.second.size();
+        }
+    }
+
+    queries.push_back({branchCondition, ret_addr, cmpId, m_batchSeed});
+    m_batchPending++;
+    m_batchPool->set(m_batchTrie.size() * sizeof(BatchNode) + m_batchPending * sizeof(BatchQuery) +
+                     m_batchSeedBytes);
+
+    if (m_batchSize && m_batchPending >= m_batchSize) {
+        flushBatch();
+    }
+}
+
+/**
+ * Walk the trie depth first, carrying the prefix and its byte partition.
+ * klee's solver has no incremental interface, so every query is still solved
+ * on its own; what is shared is the work around it: every prefix constraint
+ * has its bytes looked up and joined once per flush instead of once per
+ * query, and a query's slice is read off the partition instead of from a
+ * fixpoint over its whole path. Each query is solved against its own prefix
+ * and the concolic values it was raised under, not the state as it is now.
+ */
+void TICooperator::flushBatch() {
+    if (!m_batchPending || !m_batchState) {
+        return;
+    }
+    S2EExecutionState *state = m_batchState;
+
+    BytePartition partition;
+    std::vector<klee::ref<klee::Expr>> prefix;
+    std::vector<unsigned> prefixIds;
+
+    auto solveNode = [&](unsigned node) {
+        if (m_batchTrie[node].queries.empty()) {
+            return;
+        }
+
+        ConstraintManager constraints(prefix);
+        m_batchConstraints = &constraints;
+        auto current = state->concolics;
+        for (const auto &q : m_batchTrie[node].queries) {
+            state->concolics = q.seed;
+            std::set<SymbolicByte> bytes;
+            collectSymbolicBytes(q.condition, bytes);
+            std::set<unsigned> roots;
+            partition.roots(bytes, roots);
+
+            std::vector<klee::ref<klee::Expr>> slice;
+            for (unsigned i = 0; i < prefix.size(); i++) {
+                if (prefixIds[i] == BytePartition::NONE || !roots.count(partition.find(prefixIds[i]))) {
+                    continue;
+                }
+                std::set<SymbolicByte> constraintBytes;
+                cachedSymbolicBytes(m_symbolicBytesCache, prefix[i], constraintBytes);
+                bytes.insert(constraintBytes.begin(), constraintBytes.end());
+                slice.push_back(prefix[i]);
+            }
+
+            m_batchPrefixTotal += prefix.size();
+            processBranch(state, q.condition, slice, bytes, q.retAddr, q.cmpId);
+        }
+        state->concolics = current;
+        m_batchConstraints = nullptr;
+    };
+
+    struct Frame {
+        unsigned node;
+        unsigned child;
+        BytePartition::Mark mark;
+    };
+    std::vector<Frame> stack;
+    stack.push_back({0, 0, partition.mark()});
+    solveNode(0);
+
+    while (!stack.empty()) {
+        Frame &frame = stack.back();
+        if (frame.child == m_batchTrie[frame.node].children.size()) {
+            partition.rollback(frame.mark);
+            if (frame.node) {
+                prefix.pop_back();
+                prefixIds.pop_back();
+            }
+            stack.pop_back();
+            continue;
+        }
+
+        unsigned child = m_batchTrie[frame.node].children[frame.child++];
+        BytePartition::Mark mark = partition.mark();
+        std::set<SymbolicByte> bytes;
+        cachedSymbolicBytes(m_symbolicBytesCache, m_batchTrie[child].constraint, bytes);
+        prefix.push_back(m_batchTrie[child].constraint);
+        prefixIds.push_back(partition.add(bytes));
+        m_batchPrefixWalked++;
+
+        stack.push_back({child, 0, mark});
+        solveNode(child);
+    }
+
+    m_batchTrie.resize(1);
+    m_batchTrie[0] = BatchNode();
+    m_batchPending = 0;
+    m_batchSeed = nullptr;
+    m_batchSeedBytes = 0;
+    m_batchPool->set(0);
+    m_batchState = nullptr;
+    m_batchFlushes++;
+    m_lastBatchFlush = klee::util::getWallTime();
+}
+
+void TICooperator::onStateKill(S2EExecutionState *state) {
+    // queries need the state for templates and seed values
+    if (state == m_batchState) {
+        flushBatch();
+        m_batchState = nullptr;
+    }
+
+    // neither may point at a freed state afterwards
+    if (m_currentState == static_cast<klee::ExecutionState *>(state)) {
+        m_currentState = nullptr;
+    }
+
+    if (!m_edgeMap.empty()) {
+        writeEdgeBitmap();
+    }
+}
+
+// the location is hashed once per translation, execution only indexes the map
+void TICooperator::onEdgeTranslate(ExecutionSignal *signal,
+                                   S2EExecutionState *state,
+                                   TranslationBlock *tb,
+                                   uint64_t pc) {
+    if (pc < m_edgeStart || pc >= m_edgeEnd) {
+        return;
+    }
+
+    uint32_t loc = ((pc >> 4) ^ (pc << 8)) & (m_edgeMap.size() - 1);
+    signal->connect(sigc::bind(sigc::mem_fun(*this, &TICooperator::onEdgeBlock), loc));
+}
+
+void TICooperator::onEdgeBlock(S2EExecutionState *state, uint64_t pc, uint32_t loc) {
+    uint8_t &count = m_edgeMap[loc ^ m_edgePrevLoc];
+    // hit counts wrap without ever reading as "not covered"
+    if (!++count) {
+        count = 1;
+    }
+    m_edgePrevLoc = loc >> 1;
+}
+
+void TICooperator::writeEdgeBitmap() {
+    std::ofstream ofs(s2e()->getOutputDirectory() + "/edges.bitmap", std::ios::out | std::ios::binary);
+    ofs.write(reinterpret_cast<const char *>(m_edgeMap.data()), m_edgeMap.size());
+    ofs.close();
+
+    if (m_edgeShm) {
+        std::memcpy(m_edgeShm, m_edgeMap.data(), m_edgeMap.size());
+    }
+
+    unsigned edges = m_edgeMap.size() - std::count(m_edgeMap.begin(), m_edgeMap.end(), 0);
+    s2e()->getDebugStream() << "TICooperator: edges covered by the concolic path: " << edges << "\n";
+    m_edgeMapWritten = true;
+}
+
+/**
+ * Solve a flipped branch and emit its testcases. slice and bytes are the
+ * constraints of pathConstraints(state) that share input bytes with
+ * branchCondition.
+ */
+void TICooperator::processBranch(S2EExecutionState *state,
+                                 const klee::ref<klee::Expr> &branchCondition,
+                                 const std::vector<klee::ref<klee::Expr>> &slice,
+                                 const std::set<SymbolicByte> &bytes,
+                                 uint64_t ret_addr,
+                                 unsigned int cmpId) {
+    double weight = m_feedback ? m_feedback->weight(cmpId) : 1;
+    m_effort = weight;
+
+    // Extract symbolic objects
+    ArrayVec symbObjects = state->symbolics;
+    std::vector<std::vector<unsigned char>> concreteObjects;
+
+    // the model and the copied constraints only live for this branch
+    uint64_t temporaries = pathConstraints(state).size() * sizeof(klee::ref<klee::Expr>);
+    for (auto array : symbObjects) {
+        temporaries += array->getSize();
+    }
+    ScopedCharge charge(m_temporariesPool, temporaries);
+
+    constraintsCount++;
+    if (!solveBranch(state, branchCondition, slice, bytes, symbObjects, concreteObjects, ret_addr)) {
+        // failed to solve new branch condition
+        unsolvedConstraints++;
+    }
+    else {
+        // success
+        solvedConstraints++;
+
+        // generate concrete input for branched condition
+        generateTestcase(state, branchCondition, symbObjects, concreteObjects, ret_addr, cmpId);
+        m_solutionCounts[ret_addr]++;
+
+        unsigned solutions = std::max(1u, unsigned(m_solutionsPerTarget * weight + 0.5));
+        if (solutions > 1) {
+            generateDiverseSolutions(state, branchCondition, symbObjects, concreteObjects, ret_addr, cmpId,
+                                     solutions);
+        }
+    }
+    m_effort = 1;
+}
+
+bool TICooperator::solveBranch(S2EExecutionState *state,
+                               const klee::ref<klee::Expr> &branchCondition,
+                               ArrayVec &symbObjects,
+                               std::vector<std::vector<unsigned char>> &concreteObjects,
+                               uint64_t ret_addr) {
+    std::vector<klee::ref<klee::Expr>> slice;
+    std::set<SymbolicByte> bytes;
+
+    sliceConstraints(state->constraints(), branchCondition, m_symbolicBytesCache, slice, bytes);
+    return solveBranch(state, branchCondition, slice, bytes, symbObjects, concreteObjects, ret_addr);
+}
+
+/**
+ * Solve the path constraints plus branchCondition.
+ *
+ * With a query cache configured, the query is first reduced to the constraints
+ * that transitively share input bytes with the branch condition. The rest of
+ * the path is independent of the branch and already satisfied by the current
+ * concolic values, so the slice alone decides the result, and the slice is
+ * what other seeds of the campaign hit again.
+ */
+bool TICooperator::solveBranch(S2EExecutionState *state,
+                               const klee::ref<klee::Expr> &branchCondition,
+                               const std::vector<klee::ref<klee::Expr>> &slice,
+                               const std::set<SymbolicByte> &bytes,
+                               ArrayVec &symbObjects,
+                               std::vector<std::vector<unsigned char>> &concreteObjects,
+                               uint64_t ret_addr) {
+    std::set<SymbolicByte> conditionBytes;
+    collectSymbolicBytes(branchCondition, conditionBytes);
+    BranchShape shape = classifyBranch(branchCondition, conditionBytes);
+
+    double shapeStart = klee::util::getWallTime();
+    auto &shapeStats = m_shapeStats[shape];
+    shapeStats.queries++;
+
+    bool overBudget = false;
+    if (m_maxQueryNodes || m_maxQueryDepth) {
+        ExprMeasure measure;
+        unsigned depth = measure.visit(branchCondition).first;
+        for (const auto &c : slice) {
+            depth = std::max(depth, measure.visit(c).first);
+        }
+        overBudget = (m_maxQueryNodes && measure.nodes.size() > m_maxQueryNodes) ||
+                     (m_maxQueryDepth && depth > m_maxQueryDepth);
+    }
+
+    // cheap shapes do not pay SMT startup cost
+    bool sat = false;
+    if (overBudget) {
+        sat = solveOverBudget(state, branchCondition, slice, bytes, conditionBytes, symbObjects, concreteObjects,
+                              ret_addr);
+    } else {
+        if (m_shapeRouting && conditionBytes.size() == 1 && conditionBytes.begin()->second != ANY_BYTE &&
+            (shape == SHAPE_SINGLE_BYTE_EQ || shape == SHAPE_RANGE)) {
+            sat = solveSingleByte(state, branchCondition, slice, *conditionBytes.begin(), symbObjects,
+                                  concreteObjects);
+            if (sat) {
+                shapeStats.fastPath++;
+            }
+        }
+
+        if (!sat) {
+            sat = solveSliced(state, branchCondition, slice, bytes, symbObjects, concreteObjects, ret_addr, shape);
+        }
+    }
+
+    if (sat && m_minimizeTestcases) {
+        std::vector<klee::ref<klee::Expr>> constraints(slice);
+        constraints.push_back(branchCondition);
+        minimizeModel(state, constraints, bytes, symbObjects, concreteObjects);
+    }
+
+    double elapsed = klee::util::getWallTime() - shapeStart;
+    shapeStats.time += elapsed;
+    if (m_heatmapEnabled) {
+        chargeHeatmap(bytes, elapsed);
+    }
+    return sat;
+}
+
+/**
+ * Queries whose DAG exceeds maxQueryNodes or maxQueryDepth (checksum loops,
+ * decompressors) would eat the solver budget. Instead:
+ *
+ *   optimistic: solve the flipped condition alone, the rest of the input
+ *               keeps its seed values
+ *   concretize: replace the subtrees that put each expression over the
+ *               limits by their concolic values, then solve the slice
+ *   dump:       write the query for offline solving and give up on it
+ *
+ * Models of the first two may diverge from the path; the divergence check
+ * tags or drops those.
+ */
+bool TICooperator::solveOverBudget(S2EExecutionState *state,
+                                   const klee::ref<klee::Expr> &branchCondition,
+                                   const std::vector<klee::ref<klee::Expr>> &slice,
+                                   const std::set<SymbolicByte> &bytes,
+                                   const std::set<SymbolicByte> &conditionBytes,
+                                   ArrayVec &symbObjects,
+                                   std::vector<std::vector<unsigned char>> &concreteObjects,
+                                   uint64_t ret_addr) {
+    auto &fallbacks = m_budgetFallbacks[ret_addr];
+    fallbacks[m_budgetFallback]++;
+
+    switch (m_budgetFallback) {
+        case FALLBACK_OPTIMISTIC: {
+            if (!solveConstraints(state, {branchCondition}, symbObjects, concreteObjects)) {
+                return false;
+            }
+            mergeSliceModel(state, conditionBytes, symbObjects, concreteObjects);
+            return true;
+        }
+
+        case FALLBACK_CONCRETIZE: {
+            std::vector<klee::ref<klee::Expr>> constraints;
+            for (const auto &c : slice) {
+                constraints.push_back(shrinkExpr(state, c));
+            }
+            constraints.push_back(shrinkExpr(state, branchCondition));
+            if (!solveConstraints(state, constraints, symbObjects, concreteObjects)) {
+                return false;
+            }
+            mergeSliceModel(state, bytes, symbObjects, concreteObjects);
+            return true;
+        }
+
+        default: {
+            ConstraintManager constraints = pathConstraints(state);
+            constraints.addConstraint(branchCondition);
+            m_deferredQueries++;
+            dumpQuery(constraints, ret_addr);
+            return false;
+        }
+    }
+}
+
+/**
+ * Replace subtrees of e by their concolic values until it fits the limits:
+ * for depth, the node at the depth limit on the deepest path; for size, the
+ * smallest subtree whose removal gets under the node limit, or the largest
+ * one if none does.
+ */
+klee::ref<klee::Expr> TICooperator::shrinkExpr(S2EExecutionState *state, klee::ref<klee::Expr> e) {
+    while (!isa<ConstantExpr>(e)) {
+        ExprMeasure measure;
+        unsigned depth = measure.visit(e).first;
+        unsigned nodes = measure.nodes.size();
+
+        const Expr *target = nullptr;
+        if (m_maxQueryDepth && depth > m_maxQueryDepth) {
+            klee::ref<klee::Expr> cur = e;
+            for (unsigned level = 1; level < std::max(2u, m_maxQueryDepth); level++) {
+                klee::ref<klee::Expr> deepest;
+                for (unsigned i = 0; i < cur->getNumKids(); i++) {
+                    auto kid = cur->getKid(i);
+                    if (deepest.isNull() || measure.nodes[kid.get()].first > measure.nodes[deepest.get()].first) {
+                        deepest = kid;
+                    }
+                }
+                cur = deepest;
+            }
+            target = cur.get();
+        } else if (m_maxQueryNodes && nodes > m_maxQueryNodes) {
+            uint64_t excess = nodes - m_maxQueryNodes;
+            const Expr *largest = nullptr;
+            uint64_t best = MAX_TREE_SIZE + 1, largestSize = 0;
+            for (const auto &it : measure.nodes) {
+                if (it.first == e.get() || it.first->getKind() == Expr::Constant) {
+                    continue;
+                }
+                uint64_t size = it.second.second;
+                if (size > excess && size < best) {
+                    best = size;
+                    target = it.first;
+                }
+                if (size > largestSize) {
+                    largestSize = size;
+                    largest = it.first;
+                }
+            }
+            if (!target) {
+                target = largest;
+            }
+        } else {
+            break;
+        }
+
+        if (!target) {
+            break;
+        }
+
+        auto value = state->concolics->evaluate(klee::ref<klee::Expr>(const_cast<Expr *>(target)));
+        std::map<const Expr *, klee::ref<klee::Expr>> memo;
+        e = replaceExpr(e, target, value, memo);
+    }
+
+    return e;
+}
+
+bool TICooperator::solveConstraints(S2EExecutionState *state,
+                                    const std::vector<klee::ref<klee::Expr>> &constraints,
+                                    ArrayVec &symbObjects,
+                                    std::vector<std::vector<unsigned char>> &concreteObjects) {
+    ConstraintManager manager;
+    for (const auto &c : constraints) {
+        if (auto ce = dyn_cast<ConstantExpr>(c)) {
+            if (!ce->isTrue()) {
+                return false;
+            }
+            continue;
+        }
+        manager.addConstraint(c);
+    }
+
+    struct klee::Query q(manager, ConstantExpr::alloc(0, Expr::Bool));
+    double start = klee::util::getWallTime();
+    bool sat = state->solver()->getInitialValues(q, symbObjects, concreteObjects);
+    m_solverTime += klee::util::getWallTime() - start;
+    m_solverCalls++;
+    return sat;
+}
+
+/**
+ * The solver picks arbitrary values for bytes it reads but does not need to
+ * change, which moves testcases away from the seed and hurts fuzzer
+ * stability. Bytes outside the slice go back to the seed outright, since the
+ * seed satisfies every constraint on them; each other changed byte goes back
+ * if the constraints reading it (the condition and its slice, plus whatever
+ * else the caller needs kept) still hold. The evaluator memoizes results
+ * under the model it started with, so each byte gets a fresh one, but only
+ * over the constraints that read the byte.
+ */
+void TICooperator::minimizeModel(S2EExecutionState *state,
+                                 const std::vector<klee::ref<klee::Expr>> &constraints,
+                                 const std::set<SymbolicByte> &bytes,
+                                 const ArrayVec &symbObjects,
+                                 std::vector<std::vector<unsigned char>> &concreteObjects) {
+    mergeSliceModel(state, bytes, symbObjects, concreteObjects);
+
+    std::map<SymbolicByte, std::vector<unsigned>> readers;
+    for (unsigned k = 0; k < constraints.size(); k++) {
+        std::set<SymbolicByte> read;
+        cachedSymbolicBytes(m_symbolicBytesCache, constraints[k], read);
+        for (const auto &b : read) {
+            readers[b].push_back(k);
+        }
+    }
+
+    unsigned tries = 0;
+    for (unsigned i = 0; i < symbObjects.size(); i++) {
+        const auto &seed = state->concolics->bindings[symbObjects[i]];
+        auto &values = concreteObjects[i];
+        for (unsigned j = 0; j < values.size() && j < seed.size(); j++) {
+            if (values[j] == seed[j]) {
+                continue;
+            }
+            if (m_minimizeBudget && tries++ >= m_minimizeBudget) {
+                m_keptBytes++;
+                continue;
+            }
+
+            unsigned char solved = values[j];
+            values[j] = seed[j];
+
+            ModelEvaluator evaluator(symbObjects, concreteObjects);
+            bool holds = true;
+            for (auto key : {SymbolicByte(symbObjects[i], j), SymbolicByte(symbObjects[i], ANY_BYTE)}) {
+                auto it = readers.find(key);
+                if (it == readers.end()) {
+                    continue;
+                }
+                for (auto k : it->second) {
+                    if (!evaluator.isTrue(constraints[k])) {
+                        holds = false;
+                        break;
+                    }
+                }
+                if (!holds) {
+                    break;
+                }
+            }
+
+            if (holds) {
+                m_minimizedBytes++;
+            } else {
+                values[j] = solved;
+                m_keptBytes++;
+            }
+        }
+    }
+}
+
+/// Solver time spent outside solveBranch, counted like its own queries.
+void TICooperator::chargeSolver(const std::set<SymbolicByte> &bytes, double seconds) {
+    m_solverTime += seconds;
+    m_solverCalls++;
+    if (m_heatmapEnabled) {
+        chargeHeatmap(bytes, seconds);
+    }
+}
+
+/**
+ * Attribute a query's time to every input byte it reads, in full and as an
+ * equal share. A symbolic index reads the whole array.
+ */
+void TICooperator::chargeHeatmap(const std::set<SymbolicByte> &bytes, double seconds) {
+    unsigned count = 0;
+    for (const auto &b : bytes) {
+        count += b.second == ANY_BYTE ? b.first->getSize() : 1;
+    }
+    if (!count) {
+        return;
+    }
+
+    auto charge = [&](const klee::Array *array, uint32_t index) {
+        auto &cost = m_heatmap[std::make_pair(array, index)];
+        cost.queries++;
+        cost.time += seconds;
+        cost.share += seconds / count;
+    };
+
+    for (const auto &b : bytes) {
+        if (b.second == ANY_BYTE) {
+            for (uint32_t i = 0; i < b.first->getSize(); i++) {
+                charge(b.first, i);
+            }
+        } else {
+            charge(b.first, b.second);
+        }
+    }
+}
+
+// array, offset, queries, seconds, seconds shared with the other bytes read
+void TICooperator::writeHeatmap() {
+    std::string path = s2e()->getOutputDirectory() + "/heatmap.stats";
+    std::string tmpPath = path + ".tmp";
+    std::ofstream ofs(tmpPath, std::ios::out);
+    for (const auto &it : m_heatmap) {
+        ofs << it.first.first->getName() << " " << it.first.second << " " << it.second.queries << " "
+            << it.second.time << " " << it.second.share << "\n";
+    }
+    ofs.close();
+
+    // TI may read it while we run
+    rename(tmpPath.c_str(), path.c_str());
+}
+
+bool TICooperator::solveSliced(S2EExecutionState *state,
+                               const klee::ref<klee::Expr> &branchCondition,
+                               const std::vector<klee::ref<klee::Expr>> &slice,
+                               const std::set<SymbolicByte> &bytes,
+                               ArrayVec &symbObjects,
+                               std::vector<std::vector<unsigned char>> &concreteObjects,
+                               uint64_t ret_addr,
+                               BranchShape shape) {
+    uint64_t key = 0;
+
+    if (m_unsatCores && containsUnsatCore(slice, branchCondition)) {
+        m_coreSkips[ret_addr]++;
+        return false;
+    }
+
+    if (m_queryCache) {
+        key = canonicalQueryHash(slice, branchCondition);
+
+        QueryCacheEntry entry;
+        if (m_queryCache->lookup(key, entry) && entry.sat &&
+            applyCachedModel(state, entry, slice, branchCondition, symbObjects, concreteObjects)) {
+            m_cacheSavedTime += m_solverCalls ? m_solverTime / m_solverCalls : 0;
+            return true;
+        }
+    }
+
+    ConstraintManager tmpConstraints = pathConstraints(state);
+    tmpConstraints.addConstraint(branchCondition);
+
+    QueryFeatures features = {};
+    double predicted = 0;
+    if (m_costBudget > 0) {
+        features = queryFeatures(slice, branchCondition, bytes);
+        predicted = m_costModel.predict(features);
+        if (m_costModel.observations() >= m_costWarmup && predicted > m_costBudget * m_effort &&
+            (!m_costExplore || ++m_overBudgetQueries % m_costExplore)) {
+            m_deferredQueries++;
+            dumpQuery(tmpConstraints, ret_addr);
+            return false;
+        }
+    }
+
+    struct klee::Query q(tmpConstraints, ConstantExpr::alloc(0, Expr::Bool));
+    auto solver = state->solver();
+
+    double start = klee::util::getWallTime();
+    std::string queryFile;
+    bool racing = !m_portfolio.empty() && startPortfolio(q, symbObjects, queryFile);
+    bool sat = solver->getInitialValues(q, symbObjects, concreteObjects);
+    if (racing) {
+        if (sat) {
+            SolverModel unused;
+            std::string winner;
+            m_portfolio.finish(0, winner, unused);
+            m_portfolioWins[shape]["s2e"]++;
+        } else {
+            // unsat or a solver timeout, a backend may have found a model
+            bool answered = false;
+            sat = finishPortfolio(state, q, shape, symbObjects, concreteObjects, answered);
+        }
+        unlink(queryFile.c_str());
+    }
+    double elapsed = klee::util::getWallTime() - start;
+    m_solverTime += elapsed;
+    m_solverCalls++;
+
+    if (m_costBudget > 0) {
+        m_costModel.update(features, elapsed);
+        *m_costOfs << predicted << "," << elapsed << "," << sat << "," << features.constraints << ","
+                   << features.nodes << "," << features.bytes << "," << features.mulDiv << "," << features.shift
+                   << "\n";
+    }
+
+    if (m_unsatCores && !sat) {
+        recordUnsatCore(state, slice, branchCondition);
+    }
+
+    // getInitialValues does not tell unsat from a solver timeout,
+    // so only models are worth sharing
+    if (m_queryCache && sat) {
+        QueryCacheEntry entry;
+        entry.sat = true;
+
+        std::map<const Array *, unsigned> objectIndex;
+        for (unsigned i = 0; i < symbObjects.size(); i++) {
+            objectIndex[symbObjects[i]] = i;
+        }
+
+        for (const auto &b : bytes) {
+            auto oi = objectIndex.find(b.first);
+            if (oi == objectIndex.end()) {
+                continue;
+            }
+
+            const auto &values = concreteObjects[oi->second];
+            if (b.second == ANY_BYTE) {
+                for (unsigned i = 0; i < values.size(); i++) {
+                    entry.bytes.push_back({b.first->getName(), i, values[i]});
+                }
+            } else if (b.second < values.size()) {
+                entry.bytes.push_back({b.first->getName(), b.second, values[b.second]});
+            }
+        }
+
+        m_queryCache->insert(key, entry);
+    }
+
+    return sat;
+}
+
+/**
+ * Start the configured external solvers on the query, printed as SMT-LIB.
+ * They run while S2E's own solver works on the same query in-process; the
+ * caller removes queryFile once the race is finished.
+ */
+bool TICooperator::startPortfolio(const klee::Query &query, const ArrayVec &symbObjects, std::string &queryFile) {
+    // a unique file per query, the backends open it by name after the spawn
+    queryFile = s2e()->getOutputDirectory() + "/portfolio-XXXXXX.smt2";
+    int fd = mkstemps(&queryFile[0], 5);
+    if (fd < 0) {
+        return false;
+    }
+    {
+        llvm::raw_fd_ostream os(fd, true);
+        klee::ExprSMTLIBPrinter printer;
+        printer.setOutput(os);
+        printer.setQuery(query);
+        printer.setArrayValuesToGet(symbObjects);
+        printer.generateOutput();
+    }
+
+    if (!m_portfolio.start(queryFile)) {
+        unlink(queryFile.c_str());
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Collect the external solvers after S2E's solver came back without a model.
+ * They get at most portfolioTimeout more seconds (0 takes only answers that
+ * already arrived). answered is false when none of them came back with sat
+ * or unsat, or when the winning model does not satisfy the query.
+ */
+bool TICooperator::finishPortfolio(S2EExecutionState *state,
+                                   const klee::Query &query,
+                                   BranchShape shape,
+                                   ArrayVec &symbObjects,
+                                   std::vector<std::vector<unsigned char>> &concreteObjects,
+                                   bool &answered) {
+    std::string winner;
+    SolverModel model;
+    PortfolioResult result = m_portfolio.finish(m_portfolioTimeout * m_effort, winner, model);
+    if (result == PORTFOLIO_UNKNOWN) {
+        m_portfolioUnknown++;
+        answered = false;
+        return false;
+    }
+
+    if (result == PORTFOLIO_UNSAT) {
+        answered = true;
+        m_portfolioWins[shape][winner]++;
+        return false;
+    }
+
+    // bytes the solver was not asked about keep their seed values
+    concreteObjects.clear();
+    for (auto array : symbObjects) {
+        auto values = state->concolics->bindings[array];
+        values.resize(array->getSize());
+        auto it = model.find(array->getName());
+        if (it != model.end()) {
+            for (const auto &byte : it->second) {
+                if (byte.first < values.size()) {
+                    values[byte.first] = byte.second;
+                }
+            }
+        }
+        concreteObjects.push_back(values);
+    }
+
+    // an external answer is only as good as its model
+    ModelEvaluator evaluator(symbObjects, concreteObjects);
+    for (const auto &c : query.constraints) {
+        if (!evaluator.isTrue(c)) {
+            getWarningsStream(state) << "portfolio model from " << winner << " does not satisfy the query\n";
+            m_portfolioRejected++;
+            answered = false;
+            return false;
+        }
+    }
+
+    answered = true;
+    m_portfolioWins[shape][winner]++;
+    return true;
+}
+
+QueryFeatures TICooperator::queryFeatures(const std::vector<klee::ref<klee::Expr>> &slice,
+                                          const klee::ref<klee::Expr> &branchCondition,
+                                          const std::set<SymbolicByte> &bytes) {
+    QueryFeatures features = {};
+    features.constraints = slice.size() + 1;
+    features.bytes = bytes.size();
+
+    std::vector<klee::ref<klee::Expr>> stack(slice.begin(), slice.end());
+    stack.push_back(branchCondition);
+    std::set<const Expr *> visited;
+    while (!stack.empty()) {
+        klee::ref<klee::Expr> cur = stack.back();
+        stack.pop_back();
+        if (!visited.insert(cur.get()).second) {
+            continue;
+        }
+
+        features.nodes++;
+        switch (cur->getKind()) {
+            case Expr::Mul:
+            case Expr::UDiv:
+            case Expr::SDiv:
+            case Expr::URem:
+            case Expr::SRem:
+                features.mulDiv = true;
+                break;
+            case Expr::Shl:
+            case Expr::LShr:
+            case Expr::AShr:
+                features.shift = true;
+                break;
+            default:
+                break;
+        }
+
+        for (unsigned i = 0; i < cur->getNumKids(); i++) {
+            stack.push_back(cur->getKid(i));
+        }
+    }
+
+    return features;
+}
+
+// kquery for offline solving, e.g. with kleaver
+void TICooperator::dumpQuery(const ConstraintManager &constraints, uint64_t ret_addr) {
+    char name[64];
+    snprintf(name, sizeof(name), "/deferred/query-%06u-%lx.kquery", m_deferredQueries, ret_addr);
+
+    std::error_code ec;
+    llvm::raw_fd_ostream os(s2e()->getOutputDirectory() + name, ec, llvm::sys::fs::F_None);
+    if (ec) {
+        getWarningsStream() << "unable to dump deferred query " << name << "\n";
+        return;
+    }
+    klee::ExprPPrinter::printQuery(os, constraints, ConstantExpr::alloc(0, Expr::Bool));
+}
+
+/**
+ * Shape of a branch condition, used to route it to the cheapest engine that
+ * can solve it and to see where solver time goes.
+ */
+BranchShape TICooperator::classifyBranch(const klee::ref<klee::Expr> &condition,
+                                         const std::set<SymbolicByte> &bytes) {
+    // look through klee's (Eq false x) negations
+    klee::ref<klee::Expr> e = condition;
+    while (e->getKind() == Expr::Eq && isa<ConstantExpr>(e->getKid(0)) && e->getKid(1)->getWidth() == Expr::Bool) {
+        e = e->getKid(1);
+    }
+
+    bool arithmetic = false, mulDiv = false;
+    std::vector<klee::ref<klee::Expr>> stack{e};
+    std::set<const Expr *> visited;
+    while (!stack.empty()) {
+        klee::ref<klee::Expr> cur = stack.back();
+        stack.pop_back();
+        if (!visited.insert(cur.get()).second) {
+            continue;
+        }
+
+        switch (cur->getKind()) {
+            case Expr::Mul:
+            case Expr::UDiv:
+            case Expr::SDiv:
+            case Expr::URem:
+            case Expr::SRem:
+                mulDiv = true;
+                break;
+            case Expr::Add:
+            case Expr::Sub:
+            case Expr::And:
+            case Expr::Or:
+            case Expr::Xor:
+            case Expr::Shl:
+            case Expr::LShr:
+            case Expr::AShr:
+                arithmetic = true;
+                break;
+            case Expr::Read:
+                // index expressions are not part of the compared value
+                continue;
+            default:
+                break;
+        }
+
+        for (unsigned i = 0; i < cur->getNumKids(); i++) {
+            stack.push_back(cur->getKid(i));
+        }
+    }
+
+    if (mulDiv) {
+        return SHAPE_MULDIV;
+    }
+    if (arithmetic) {
+        return SHAPE_ARITHMETIC;
+    }
+
+    switch (e->getKind()) {
+        case Expr::Eq:
+        case Expr::Ne:
+            return bytes.size() == 1 ? SHAPE_SINGLE_BYTE_EQ : SHAPE_MULTI_BYTE_EQ;
+        case Expr::Ult:
+        case Expr::Ule:
+        case Expr::Ugt:
+        case Expr::Uge:
+        case Expr::Slt:
+        case Expr::Sle:
+        case Expr::Sgt:
+        case Expr::Sge:
+            return SHAPE_RANGE;
+        default:
+            return SHAPE_OTHER;
+    }
+}
+
+/**
+ * Byte fast path for conditions on a single input byte: try the byte's values,
+ * constants of the condition and their neighbours first, and check each
+ * candidate against the condition and its slice with the evaluator. Bytes
+ * outside the slice are untouched, so the rest of the path still holds.
+ */
+bool TICooperator::solveSingleByte(S2EExecutionState *state,
+                                   const klee::ref<klee::Expr> &branchCondition,
+                                   const std::vector<klee::ref<klee::Expr>> &slice,
+                                   const SymbolicByte &byte,
+                                   ArrayVec &symbObjects,
+                                   std::vector<std::vector<unsigned char>> &concreteObjects) {
+    auto position = std::find(symbObjects.begin(), symbObjects.end(), byte.first);
+    if (position == symbObjects.end()) {
+        return false;
+    }
+    unsigned object = position - symbObjects.begin();
+
+    std::vector<std::vector<unsigned char>> model;
+    for (auto array : symbObjects) {
+        model.push_back(state->concolics->bindings[array]);
+    }
+    if (byte.second >= model[object].size()) {
+        return false;
+    }
+
+    std::vector<unsigned> candidates;
+    std::vector<klee::ref<klee::Expr>> stack{branchCondition};
+    while (!stack.empty()) {
+        klee::ref<klee::Expr> cur = stack.back();
+        stack.pop_back();
+        if (auto ce = dyn_cast<ConstantExpr>(cur)) {
+            unsigned c = ce->getZExtValue() & 0xff;
+            candidates.insert(candidates.end(), {c, (c + 1) & 0xff, (c - 1) & 0xff, c ^ 0xff});
+        }
+        for (unsigned i = 0; i < cur->getNumKids(); i++) {
+            stack.push_back(cur->getKid(i));
+        }
+    }
+    for (unsigned v = 0; v < 256; v++) {
+        candidates.push_back(v);
+    }
+
+    std::vector<bool> tried(256, false);
+    for (unsigned v : candidates) {
+        if (tried[v]) {
+            continue;
+        }
+        tried[v] = true;
+
+        model[object][byte.second] = v;
+        ModelEvaluator evaluator(symbObjects, model);
+        if (!evaluator.isTrue(branchCondition)) {
+            continue;
+        }
+        if (std::all_of(slice.begin(), slice.end(),
+                        [&evaluator](const klee::ref<klee::Expr> &c) { return evaluator.isTrue(c); })) {
+            concreteObjects.swap(model);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/**
+ * klee's solver interface does not expose unsat cores, so they are computed
+ * here: the slice of an unsat branch query is already a core, since the rest
+ * of the path is satisfied by the concolic values. Small slices are then
+ * shrunk by deletion, one mayBeTrue query per constraint.
+ *
+ * Cores are stored as the constraint expressions, indexed by the branch
+ * condition they came from; hashes only pick the candidates, a match is
+ * decided by expression equality. A later query with the same condition
+ * whose slice contains every constraint of a stored core is unsat as well
+ * and is answered without the solver.
+ */
+bool TICooperator::containsUnsatCore(const std::vector<klee::ref<klee::Expr>> &slice,
+                                     const klee::ref<klee::Expr> &branchCondition) {
+    auto cores = m_unsatCores->get(branchCondition);
+    if (!cores) {
+        return false;
+    }
+
+    klee::ExprHashSet constraints(slice.begin(), slice.end());
+    for (const auto &core : *cores) {
+        if (std::all_of(core.begin(), core.end(),
+                        [&constraints](const klee::ref<klee::Expr> &c) { return constraints.count(c) > 0; })) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TICooperator::recordUnsatCore(S2EExecutionState *state,
+                                   const std::vector<klee::ref<klee::Expr>> &slice,
+                                   const klee::ref<klee::Expr> &branchCondition) {
+    // solver time like any other query; the heatmap already gets it, this
+    // runs inside solveBranch
+    auto solver = state->solver();
+    auto isUnsat = [&](const std::vector<klee::ref<klee::Expr>> &constraints) {
+        ConstraintManager cm(constraints);
+        bool mayBeTrue;
+        double start = klee::util::getWallTime();
+        bool unsat = solver->mayBeTrue(klee::Query(cm, branchCondition), mayBeTrue) && !mayBeTrue;
+        m_solverTime += klee::util::getWallTime() - start;
+        m_solverCalls++;
+        return unsat;
+    };
+
+    // the failed query may have been a timeout rather than unsat
+    if (!isUnsat(slice)) {
+        return;
+    }
+
+    std::vector<klee::ref<klee::Expr>> core(slice);
+    if (core.size() <= m_unsatCoreMinimize) {
+        for (unsigned i = 0; i < core.size();) {
+            std::vector<klee::ref<klee::Expr>> candidate(core);
+            candidate.erase(candidate.begin() + i);
+            if (isUnsat(candidate)) {
+                core.swap(candidate);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    std::vector<std::vector<klee::ref<klee::Expr>>> cores;
+    if (auto known = m_unsatCores->get(branchCondition)) {
+        cores = *known;
+    }
+    cores.push_back(core);
+    m_unsatCores->put(branchCondition, cores);
+    m_unsatCoreCount++;
+}
+
+/**
+ * Rebuild a full model from a cached slice model: bytes outside the slice keep
+ * their current concolic values. The result is checked against the slice, so a
+ * hash collision costs a solver call instead of a bogus testcase.
+ */
+bool TICooperator::applyCachedModel(S2EExecutionState *state,
+                                    const QueryCacheEntry &entry,
+                                    const std::vector<klee::ref<klee::Expr>> &slice,
+                                    const klee::ref<klee::Expr> &branchCondition,
+                                    ArrayVec &symbObjects,
+                                    std::vector<std::vector<unsigned char>> &concreteObjects) {
+    klee::Assignment assignment(*state->concolics);
+
+    std::map<std::string, const Array *> arrays;
+    for (auto array : symbObjects) {
+        arrays[array->getName()] = array;
+    }
+
+    for (const auto &b : entry.bytes) {
+        auto ai = arrays.find(b.array);
+        if (ai == arrays.end()) {
+            return false;
+        }
+
+        auto &values = assignment.bindings[ai->second];
+        if (b.index >= values.size()) {
+            return false;
+        }
+        values[b.index] = b.value;
+    }
+
+    auto holds = [&assignment](const klee::ref<klee::Expr> &e) {
+        ConstantExpr *ce = dyn_cast<ConstantExpr>(assignment.evaluate(e));
+        return ce && ce->isTrue();
+    };
+
+    if (!holds(branchCondition) || !std::all_of(slice.begin(), slice.end(), holds)) {
+        return false;
+    }
+
+    concreteObjects.clear();
+    for (auto array : symbObjects) {
+        concreteObjects.push_back(assignment.bindings[array]);
+    }
+
+    return true;
+}
+
+void TICooperator::generateTestcase(S2EExecutionState *state,
+                                          const klee::ref<klee::Expr> &branchCondition,
+                                          const ArrayVec &symbObjects,
+                                          const std::vector<std::vector<unsigned char>> &concreteObjects, 
+                                          uint64_t ret_addr, unsigned int cmpId,
+                                          const std::string &tag) {
+    std::string suffix = tag;
+    if (m_divergencePolicy != DIVERGENCE_OFF) {
+        DivergenceResult result = checkDivergence(state, branchCondition, symbObjects, concreteObjects, cmpId);
+        if (result == DIVERGES_ON_BRANCH || (result == DIVERGES_ON_PATH && m_divergencePolicy == DIVERGENCE_DROP)) {
+            return;
+        }
+        if (result == DIVERGES_ON_PATH) {
+            suffix += suffix.empty() ? "diverged" : "-diverged";
+        }
+    }
+
+    if (m_pipeline) {
+        ModelEvaluator evaluator(symbObjects, concreteObjects);
+        if (!evaluator.isTrue(branchCondition)) {
+            getWarningsStream(state) << "branched model does not satisfy the flipped condition\n";
+            return;
+        }
+        submitTestcase(state, symbObjects, concreteObjects, ret_addr, cmpId, suffix);
+        m_testcasesEmitted++;
+        if (m_feedback) {
+            m_feedback->emitted(cmpId);
+        }
+        return;
+    }
+
+    // create branched state and use it to solve concrete input,
+    // we won't add the branched state to addedState.    
+    ExecutionState *branchedState;
+    branchedState = state->clone();
+
+    // Update concrete values for the branched state
+    branchedState->concolics->clear();
+    for (unsigned i = 0; i < symbObjects.size(); ++i) {
+        branchedState->concolics->add(symbObjects[i], concreteObjects[i]);
+    }
+
+    // Add constraint to branched state. A batched query is checked against
+    // the model only, the state has moved past the prefix it was raised under
+    // and may already hold the negated condition.
+    bool satisfied = m_batchConstraints ? ModelEvaluator(symbObjects, concreteObjects).isTrue(branchCondition)
+                                        : branchedState->addConstraint(branchCondition);
+    if (!satisfied) {
+        getWarningsStream(state) << "branched model does not satisfy the flipped condition\n";
+        delete branchedState;
+        return;
+    }
+    
+    // numbered like the pipeline's testcases, so both modes name alike
+    S2EExecutionState *newState = static_cast<S2EExecutionState *>(branchedState);
+    char idStr[32];
+    std::snprintf(idStr, 32, "/id:%06u-%lx-%u", m_testcaseId++, ret_addr, cmpId);
+    std::string prefix(idStr);
+    if (!suffix.empty()) {
+        prefix += "-" + suffix;
+    }
+
+    // generate concrete input through branched state condition
+    m_TestCaseGenerator->generateTestCases(newState, prefix, testcases::TestCaseType::TC_FILE);
+    m_testcasesEmitted++;
+    if (m_feedback) {
+        m_feedback->emitted(cmpId);
+    }
+    
+    // release branched state
+    delete branchedState;
+}
+
+/**
+ * Concretization, cached or optimistic models and untracked environment can
+ * produce models that do not reach the flipped branch. Replaying the path
+ * prefix and the flipped condition under the model catches them without
+ * running the guest again. The seed satisfies the whole path, so only the
+ * constraints reading a byte the model changed need replaying.
+ */
+TICooperator::DivergenceResult TICooperator::checkDivergence(S2EExecutionState *state,
+                                                             const klee::ref<klee::Expr> &branchCondition,
+                                                             const ArrayVec &symbObjects,
+                                                             const std::vector<std::vector<unsigned char>> &model,
+                                                             unsigned int cmpId) {
+    ModelEvaluator evaluator(symbObjects, model);
+    auto &stats = m_divergence[cmpId];
+    stats.first++;
+
+    DivergenceResult result = NO_DIVERGENCE;
+    if (!evaluator.isTrue(branchCondition)) {
+        result = DIVERGES_ON_BRANCH;
+    } else {
+        std::set<SymbolicByte> changed;
+        for (unsigned i = 0; i < symbObjects.size() && i < model.size(); i++) {
+            const auto &seed = state->concolics->bindings[symbObjects[i]];
+            for (unsigned j = 0; j < model[i].size(); j++) {
+                if (j >= seed.size() || model[i][j] != seed[j]) {
+                    changed.insert(SymbolicByte(symbObjects[i], j));
+                }
+            }
+        }
+
+        for (const auto &c : pathConstraints(state)) {
+            std::set<SymbolicByte> bytes;
+            cachedSymbolicBytes(m_symbolicBytesCache, c, bytes);
+            if (!sharesBytes(bytes, changed)) {
+                continue;
+            }
+            if (!evaluator.isTrue(c)) {
+                result = DIVERGES_ON_PATH;
+                break;
+            }
+        }
+    }
+
+    if (result != NO_DIVERGENCE) {
+        stats.second++;
+    }
+    return result;
+}
+
+/**
+ * Hand a model to the testcase pipeline. Everything the pipeline threads need
+ * is copied here, on the emulation thread: the model and the concrete file
+ * templates it is merged into.
+ */
+void TICooperator::submitTestcase(S2EExecutionState *state,
+                                  const ArrayVec &symbObjects,
+                                  const std::vector<std::vector<unsigned char>> &concreteObjects,
+                                  uint64_t ret_addr, unsigned int cmpId,
+                                  const std::string &suffix) {
+    klee::Assignment assignment;
+    for (unsigned i = 0; i < symbObjects.size(); ++i) {
+        assignment.add(symbObjects[i], concreteObjects[i]);
+    }
+    testcases::ConcreteFileTemplates templates = m_TestCaseGenerator->getTemplates(state);
+
+    uint64_t bytes = 0;
+    for (const auto &values : concreteObjects) {
+        bytes += values.size();
+    }
+    for (const auto &file : templates) {
+        bytes += file.first.size() + file.second.size();
+    }
+
+    TestcaseInfo info = {m_testcaseId++, ret_addr, cmpId, suffix};
+    m_pipeline->submit({info, [assignment, templates](TestcaseFiles &files) {
+        testcases::TestCaseData data;
+        testcases::TestCaseGenerator::assembleTestCaseToFiles(assignment, templates, data);
+        for (const auto &file : data) {
+            files[file.first] = file.second;
+        }
+    }, bytes});
+}
+
+void TICooperator::readCriticalBytes(const std::string &path) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        getWarningsStream() << "unable to open " << path << "\n";
+        exit(-1);
+    }
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream ls(line);
+        uint64_t target;
+        std::string array;
+        uint32_t offset;
+        if (!(ls >> std::hex >> target >> array)) {
+            continue;
+        }
+        while (ls >> std::dec >> offset) {
+            m_criticalBytes[std::make_pair(array, offset)].push_back(target);
+        }
+    }
+}
+
+// critical while some target that needs the byte is still pending
+bool TICooperator::isCritical(const SymbolicByte &b) const {
+    auto it = m_criticalBytes.find(std::make_pair(b.first->getName(), b.second));
+    if (it == m_criticalBytes.end()) {
+        return false;
+    }
+
+    for (auto target : it->second) {
+        if (!isStepped.count(target) && !m_resumedTargets.count(target)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+klee::ref<klee::Expr> TICooperator::concretizeNonCritical(S2EExecutionState *state,
+                                                          const klee::ref<klee::Expr> &condition) {
+    std::set<SymbolicByte> bytes;
+    collectSymbolicBytes(condition, bytes);
+
+    bool changed = false;
+    for (const auto &b : bytes) {
+        // a symbolic index may read a critical byte
+        if (b.second == ANY_BYTE || m_concretized.count(b) || isCritical(b)) {
+            continue;
+        }
+
+        const auto &seed = state->concolics->bindings[b.first];
+        if (b.second >= seed.size()) {
+            continue;
+        }
+
+        auto read = ReadExpr::create(UpdateList(b.first, nullptr), ConstantExpr::create(b.second, Expr::Int32));
+        if (!state->addConstraint(EqExpr::create(ConstantExpr::create(seed[b.second], Expr::Int8), read))) {
+            continue;
+        }
+
+        m_concretized[b] = std::make_pair(seed[b.second], state->regs()->getPc());
+        changed = true;
+    }
+
+    return changed ? state->simplifyExpr(condition) : condition;
+}
+
+void TICooperator::beginPhase() {
+    if (!m_inPhase) {
+        m_inPhase = true;
+        m_solvingEnabled = true;
+        m_phases.push_back(std::make_pair(klee::util::getWallTime() - m_startTime, -1.0));
+    }
+}
+
+void TICooperator::endPhase() {
+    if (m_inPhase) {
+        m_inPhase = false;
+        m_solvingEnabled = !m_scopeToPhase;
+        m_phases.back().second = klee::util::getWallTime() - m_startTime;
+    }
+}
+
+void TICooperator::onPhaseTranslate(ExecutionSignal *signal,
+                                    S2EExecutionState *state,
+                                    TranslationBlock *tb,
+                                    uint64_t pc) {
+    if (m_phaseBeginPcs.count(pc) || m_phaseEndPcs.count(pc)) {
+        signal->connect(sigc::mem_fun(*this, &TICooperator::onPhaseMarker));
+    }
+}
+
+void TICooperator::onPhaseMarker(S2EExecutionState *state, uint64_t pc) {
+    // a pc in both sets toggles, e.g. a function entered once per input
+    if (m_phaseBeginPcs.count(pc) && !m_inPhase) {
+        beginPhase();
+    } else if (m_phaseEndPcs.count(pc)) {
+        endPhase();
+    }
+}
+
+void TICooperator::setBudget(S2EExecutionState *state, uint32_t kind, uint64_t value) {
+    switch (kind) {
+        case TICOOP_BUDGET_SOLUTIONS:
+            m_solutionsPerTarget = std::max<uint64_t>(1, value);
+            break;
+        case TICOOP_BUDGET_JUMP_TARGETS:
+            m_jumpTargetBudget = value;
+            if (value) {
+                connectAddressHook();
+            }
+            break;
+        case TICOOP_BUDGET_MINIMIZE:
+            m_minimizeBudget = value;
+            break;
+        default:
+            getWarningsStream(state) << "Unknown budget " << kind << "\n";
+            return;
+    }
+    getDebugStream(state) << "budget " << kind << " set to " << value << "\n";
+}
+
+// regions are kept disjoint, keyed by start
+void TICooperator::disableRegion(uint64_t start, uint64_t end) {
+    if (start >= end) {
+        return;
+    }
+    enableRegion(start, end);
+    m_disabledRegions[start] = end;
+}
+
+void TICooperator::enableRegion(uint64_t start, uint64_t end) {
+    auto it = m_disabledRegions.lower_bound(start);
+    if (it != m_disabledRegions.begin() && std::prev(it)->second > start) {
+        --it;
+    }
+
+    while (it != m_disabledRegions.end() && it->first < end) {
+        uint64_t regionStart = it->first, regionEnd = it->second;
+        it = m_disabledRegions.erase(it);
+        // keep whatever sticks out on either side
+        if (regionStart < start) {
+            m_disabledRegions[regionStart] = start;
+        }
+        if (regionEnd > end) {
+            m_disabledRegions[end] = regionEnd;
+        }
+    }
+}
+
+bool TICooperator::inDisabledRegion(uint64_t pc) const {
+    auto it = m_disabledRegions.upper_bound(pc);
+    if (it == m_disabledRegions.begin()) {
+        return false;
+    }
+    return pc < std::prev(it)->second;
+}
+
+// the phase and region scope of onStateForkDecide, for the other solving hooks
+bool TICooperator::inSolvingScope(uint64_t pc) const {
+    return m_solvingEnabled && (m_disabledRegions.empty() || !inDisabledRegion(pc));
+}
+
+void TICooperator::writeCounters(S2EExecutionState *state, uint64_t buffer, uint64_t size) {
+    S2E_TICooperator_COUNTERS counters;
+    counters.Constraints = constraintsCount;
+    counters.Solved = solvedConstraints;
+    counters.Unsolved = unsolvedConstraints;
+    counters.Targets = retAddr.size();
+    counters.Stepped = isStepped.size();
+    counters.Testcases = m_testcasesEmitted;
+    counters.SolverMicroseconds = m_solverTime * 1000000;
+    counters.InPhase = m_inPhase;
+
+    // older guests may pass a shorter buffer
+    if (!state->mem()->write(buffer, &counters, std::min<uint64_t>(size, sizeof(counters)))) {
+        getWarningsStream(state) << "could not write counters\n";
+    }
+}
+
+void TICooperator::connectAddressHook() {
+    if (!m_addressHookConnected) {
+        s2e()->getCorePlugin()->onSymbolicAddress.connect(sigc::mem_fun(*this, &TICooperator::onSymbolicAddress));
+        m_addressHookConnected = true;
+    }
+}
+
+void TICooperator::initTestcaseDirectory() {
+    dirPath = s2e()->getOutputDirectory() + "/testcase-";
+    std::error_code mkdirError = llvm::sys::fs::create_directories(dirPath);
+    if (mkdirError) {
+        s2e()->getDebugStream() << "Could not create testcase directory " << dirPath << " error: " << mkdirError.message()
+                  << "\n";
+        exit(-1);
+    }
+    mode_t m = umask(0);
+    umask(m);
+    chmod(dirPath.c_str(), 0775 & ~m);
+}
+
+void TICooperator::readSelectedRetAddr() {
+    std::ifstream ifs("ret_addr");
+    size_t instRetAddr;
+    unsigned int cmpId;
+    if (!ifs) {
+        s2e()->getDebugStream() << "Unable to open ret_addr\n";
+    }
+    while(!ifs.eof()) {
+        ifs >> std::hex >> instRetAddr >> std::dec >> cmpId;
+        retAddr.emplace(std::make_pair(instRetAddr, cmpId));
+    }
+    ifs.close();
+}
+
+void TICooperator::readCutoffMarkers(const std::string &path) {
+    std::ifstream ifs(path);
+    if (!ifs) {
+        s2e()->getDebugStream() << "Unable to open " << path << "\n";
+        return;
+    }
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream ls(line);
+        uint64_t marker, target;
+        if (!(ls >> std::hex >> marker)) {
+            continue;
+        }
+        auto &targets = m_cutoffMarkers[marker];
+        while (ls >> std::hex >> target) {
+            targets.push_back(target);
+        }
+    }
+    ifs.close();
+
+    s2e()->getDebugStream() << "TICooperator: " << m_cutoffMarkers.size() << " cutoff markers\n";
+}
+
+void TICooperator::onCutoffTranslate(ExecutionSignal *signal,
+                                     S2EExecutionState *state,
+                                     TranslationBlock *tb,
+                                     uint64_t pc) {
+    if (m_cutoffMarkers.count(pc)) {
+        signal->connect(sigc::mem_fun(*this, &TICooperator::onCutoffMarker));
+    }
+}
+
+void TICooperator::onCutoffMarker(S2EExecutionState *state, uint64_t pc) {
+    for (auto target : m_cutoffMarkers[pc]) {
+        if (retAddr.count(target) && !isStepped.count(target) && !m_resumedTargets.count(target)) {
+            return;
+        }
+    }
+
+    m_cutoffPc = pc;
+    m_cutoffTime = klee::util::getUserTime();
+
+    std::ostringstream reason;
+    reason << "no reachable target left at " << std::hex << pc;
+    s2e()->getDebugStream(state) << "TICooperator: " << reason.str() << "\n";
+    if (m_currentState == static_cast<klee::ExecutionState *>(state)) {
+        m_currentState = nullptr;
+    }
+    s2e()->getExecutor()->terminateState(*state, reason.str());
+}
+
+std::string TICooperator::serializeCheckpoint() {
+    SnapshotWriter writer;
+
+    writer.beginSection(TICOOP_CKPT_COUNTERS);
+    writer.writeU32(constraintsCount);
+    writer.writeU32(solvedConstraints);
+    writer.writeU32(unsolvedConstraints);
+    writer.endSection();
+
+    writer.beginSection(TICOOP_CKPT_STEPPED);
+    writer.writeU32(isStepped.size());
+    for (auto addr : isStepped) {
+        writer.writeU64(addr);
+    }
+    writer.endSection();
+
+    writer.beginSection(TICOOP_CKPT_SOLUTIONS);
+    writer.writeU32(m_solutionCounts.size());
+    for (const auto &it : m_solutionCounts) {
+        writer.writeU64(it.first);
+        writer.writeU32(it.second);
+    }
+    writer.endSection();
+
+    writer.beginSection(TICOOP_CKPT_JUMP_TARGETS);
+    writer.writeU32(m_jumpTargets.size());
+    for (const auto &it : m_jumpTargets) {
+        writer.writeU64(it.first);
+        writer.writeU8(m_exhaustedJumps.count(it.first));
+        writer.writeU32(it.second.size());
+        for (auto target : it.second) {
+            writer.writeU64(target);
+        }
+    }
+    writer.endSection();
+
+    writer.beginSection(TICOOP_CKPT_DICT_TOKENS);
+    writer.writeU32(m_dictTokens.size());
+    for (const auto &token : m_dictTokens) {
+        writer.writeString(token);
+    }
+    writer.endSection();
+
+    return writer.data();
+}
+
+bool TICooperator::loadCheckpoint() {
+    std::string snapshot;
+    if (!CheckpointWriter::load(m_checkpointFile, snapshot)) {
+        s2e()->getDebugStream() << "TICooperator: no checkpoint " << m_checkpointFile << ", starting from scratch\n";
+        return false;
+    }
+
+    SnapshotReader reader(snapshot);
+    if (!reader.valid()) {
+        s2e()->getWarningsStream() << "TICooperator: ignoring incompatible checkpoint " << m_checkpointFile << "\n";
+        return false;
+    }
+
+    uint32_t tag;
+    while (reader.nextSection(tag)) {
+        switch (tag) {
+            case TICOOP_CKPT_COUNTERS: {
+                reader.readU32(constraintsCount);
+                reader.readU32(solvedConstraints);
+                reader.readU32(unsolvedConstraints);
+                break;
+            }
+            case TICOOP_CKPT_STEPPED: {
+                uint32_t count = 0;
+                reader.readU32(count);
+                for (uint32_t i = 0; i < count; i++) {
+                    uint64_t addr;
+                    if (!reader.readU64(addr)) {
+                        break;
+                    }
+                    // targets may have changed since the snapshot was taken
+                    if (retAddr.count(addr)) {
+                        isStepped.emplace(addr);
+                        m_resumedTargets.emplace(addr);
+                    }
+                }
+                break;
+            }
+            case TICOOP_CKPT_SOLUTIONS: {
+                uint32_t count = 0;
+                reader.readU32(count);
+                for (uint32_t i = 0; i < count; i++) {
+                    uint64_t addr;
+                    uint32_t solutions;
+                    if (!reader.readU64(addr) || !reader.readU32(solutions)) {
+                        break;
+                    }
+                    if (retAddr.count(addr)) {
+                        m_solutionCounts[addr] = solutions;
+                    }
+                }
+                break;
+            }
+            case TICOOP_CKPT_JUMP_TARGETS: {
+                uint32_t count = 0;
+                reader.readU32(count);
+                for (uint32_t i = 0; i < count; i++) {
+                    uint64_t pc;
+                    uint8_t exhausted;
+                    uint32_t targets;
+                    if (!reader.readU64(pc) || !reader.readU8(exhausted) || !reader.readU32(targets)) {
+                        break;
+                    }
+                    auto &seen = m_jumpTargets[pc];
+                    for (uint32_t j = 0; j < targets; j++) {
+                        uint64_t target;
+                        if (!reader.readU64(target)) {
+                            break;
+                        }
+                        seen.insert(target);
+                    }
+                    if (exhausted) {
+                        m_exhaustedJumps.insert(pc);
+                    }
+                }
+                break;
+            }
+            case TICOOP_CKPT_DICT_TOKENS: {
+                // written to this run's ticoop.dict once it is opened
+                uint32_t count = 0;
+                reader.readU32(count);
+                for (uint32_t i = 0; i < count; i++) {
+                    std::string token;
+                    if (!reader.readString(token)) {
+                        break;
+                    }
+                    m_dictTokens.insert(token);
+                }
+                break;
+            }
+            default:
+                break;
+        }
     }
-    else {
-        tmpConstraints.addConstraint(condition);
+
+    s2e()->getDebugStream() << "TICooperator: resumed from " << m_checkpointFile << ", " << isStepped.size()
+                            << " targets already stepped\n";
+    return true;
+}
+
+void TICooperator::saveCheckpoint(bool sync) {
+    std::string snapshot = serializeCheckpoint();
+    if (sync) {
+        m_checkpointWriter->writeNow(snapshot);
+    } else {
+        m_checkpointWriter->submit(snapshot);
     }
-    
-    // Extract symbolic objects
-    ArrayVec symbObjects = state->symbolics;
-    std::vector<std::vector<unsigned char>> concreteObjects;
-    struct klee::Query q(tmpConstraints, ConstantExpr::alloc(0, Expr::Bool));
-    auto solver = state->solver();
-    
-    constraintsCount++;
-    if (!solver->getInitialValues(q, symbObjects, concreteObjects)) {
-        // failed to solve new branch condition
-        unsolvedConstraints++;
+
+    // small, written in place by rename like the snapshot
+    if (m_feedback && !m_feedback->save()) {
+        getWarningsStream() << "TICooperator: could not save fuzzer feedback state\n";
     }
-    else {
-        // success
-        solvedConstraints++;
+    m_lastCheckpoint = klee::util::getWallTime();
+}
 
-        // generate concrete input for branched condition
-        generateTestcase(state, condition, conditionIsTrue,
-                         symbObjects, concreteObjects, ret_addr, cmpId);
+/**
+ * Symbolic memory addresses, typically table lookups indexed by input bytes.
+ *
+ * The feasible range of the address is computed once per (pc, expression) and
+ * cached, since the same lookup runs over and over in parser loops. The first
+ * time a range is seen, testcases are emitted for its boundaries, tagged "oob"
+ * when a boundary lies further than symbolicAddressWindow from the address the
+ * seed uses. The policy then decides whether the address is concretized:
+ *   concolic - always concretize to the seed's address, keeps the path cheap
+ *   symbolic - leave it to the engine
+ *   range    - keep small ranges symbolic, concretize wider ones
+ */
+void TICooperator::onSymbolicAddress(S2EExecutionState *state,
+                                           klee::ref<klee::Expr> symbolicAddress,
+                                           uint64_t concreteAddress,
+                                           bool &concretize,
+                                           CorePlugin::symbolicAddressReason reason) {
+    if (!inSolvingScope(state->regs()->getPc())) {
+        return;
     }
 
-    /*if (isStepped.size() == retAddr.size())
-        s2e()->getExecutor()->terminateState(*m_currentState, "all requested inst. stepped");*/
+    if (reason == CorePlugin::symbolicAddressReason::PC) {
+        if (m_jumpTargetBudget) {
+            auto target = state->simplifyExpr(symbolicAddress);
+            if (!isa<ConstantExpr>(target)) {
+                enumerateJumpTargets(state, target, concreteAddress);
+            }
+        }
+        return;
+    }
+
+    if (m_addressPolicy == ADDRESS_POLICY_NONE) {
+        return;
+    }
+
+    auto address = state->simplifyExpr(symbolicAddress);
+    if (isa<ConstantExpr>(address)) {
+        return;
+    }
+
+    m_symbolicAddresses++;
+
+    uint64_t pc = state->regs()->getPc();
+    uint64_t key = (pc << 32) ^ address->hash();
+
+    AddressBounds bounds;
+    if (auto cached = m_addressBoundsCache->get(key)) {
+        bounds = *cached;
+        m_addressBoundsHits++;
+    } else {
+        if (!computeAddressBounds(state, address, bounds)) {
+            return;
+        }
+        m_addressBoundsCache->put(key, bounds);
+        emitAddressTestcases(state, address, concreteAddress, bounds, pc);
+    }
 
+    switch (m_addressPolicy) {
+        case ADDRESS_POLICY_CONCOLIC:
+            concretize = true;
+            break;
+        case ADDRESS_POLICY_SYMBOLIC:
+            concretize = false;
+            break;
+        case ADDRESS_POLICY_RANGE:
+            concretize = bounds.max - bounds.min > m_addressMaxRange;
+            break;
+        default:
+            break;
+    }
 }
 
-void TICooperator::generateTestcase(S2EExecutionState *state,
-                                          klee::ref<klee::Expr> &condition,
-                                          bool conditionIsTrue,
-                                          ArrayVec &symbObjects,
-                                          std::vector<std::vector<unsigned char>> &concreteObjects, 
-                                          uint64_t ret_addr, unsigned int cmpId) {
-    // create branched state and use it to solve concrete input,
-    // we won't add the branched state to addedState.    
-    ExecutionState *branchedState;
-    branchedState = state->clone();
+/**
+ * Symbolic program counters come from jump tables, e.g. the switch statements
+ * of objdump's disassemblers. They never reach onStateForkDecide, so feasible
+ * targets are enumerated here: solve, block the target found, solve again,
+ * up to jumpTargetBudget targets per jump.
+ *
+ * Each round is an independent klee query: the slice of the target plus one
+ * blocking clause per target already seen. The slice is computed once per
+ * enumeration; what the solver reuses between rounds is only what its
+ * caches recognize.
+ */
+void TICooperator::enumerateJumpTargets(S2EExecutionState *state,
+                                        const klee::ref<klee::Expr> &target,
+                                        uint64_t concreteTarget) {
+    uint64_t pc = state->regs()->getPc();
+    auto &seen = m_jumpTargets[pc];
+    seen.insert(concreteTarget);
 
-    // Update concrete values for the branched state
-    branchedState->concolics->clear();
-    for (unsigned i = 0; i < symbObjects.size(); ++i) {
-        branchedState->concolics->add(symbObjects[i], concreteObjects[i]);
+    // the budget is per jump site, a jump in a loop comes back many times
+    if (seen.size() >= m_jumpTargetBudget || m_exhaustedJumps.count(pc)) {
+        return;
+    }
+
+    std::vector<klee::ref<klee::Expr>> slice;
+    std::set<SymbolicByte> bytes;
+    sliceConstraints(state->constraints(), target, m_symbolicBytesCache, slice, bytes);
+
+    ConstraintManager session(slice);
+    for (auto known : seen) {
+        session.addConstraint(NeExpr::create(target, ConstantExpr::create(known, target->getWidth())));
     }
 
-    // Add constraint to branched state
-    if (conditionIsTrue) {
-        if (!branchedState->addConstraint(Expr::createIsZero(condition))) {
-            abort();
+    auto solver = state->solver();
+    while (seen.size() < m_jumpTargetBudget) {
+        ArrayVec symbObjects = state->symbolics;
+        std::vector<std::vector<unsigned char>> concreteObjects;
+
+        constraintsCount++;
+        if (!solver->getInitialValues(klee::Query(session, ConstantExpr::alloc(0, Expr::Bool)), symbObjects,
+                                      concreteObjects)) {
+            // no target left, or the solver gave up
+            unsolvedConstraints++;
+            m_exhaustedJumps.insert(pc);
+            break;
+        }
+        solvedConstraints++;
+
+        // the session only constrains the slice, the other bytes must keep
+        // their concolic values to stay on the current path
+        mergeSliceModel(state, bytes, symbObjects, concreteObjects);
+
+        klee::Assignment assignment;
+        for (unsigned i = 0; i < symbObjects.size(); i++) {
+            assignment.add(symbObjects[i], concreteObjects[i]);
         }
+        auto value = dyn_cast<ConstantExpr>(assignment.evaluate(target));
+        if (!value) {
+            break;
+        }
+
+        uint64_t next = value->getZExtValue();
+        seen.insert(next);
+        m_jumpTargetsFound++;
+
+        auto branch = EqExpr::create(target, ConstantExpr::create(next, target->getWidth()));
+        char tag[32];
+        std::snprintf(tag, sizeof(tag), "jmp-%lx", next);
+        generateTestcase(state, branch, symbObjects, concreteObjects, pc, siteCmpId(pc), tag);
+
+        session.addConstraint(NeExpr::create(target, ConstantExpr::create(next, target->getWidth())));
     }
-    else {
-        if (!branchedState->addConstraint(condition)) {
-            abort();
+}
+
+/**
+ * A single model is one point of what is often a wide feasible region, e.g.
+ * a length check. Up to solutionsPerTarget - 1 more models are drawn from one
+ * session over the branch slice: first the boundaries of the compared value
+ * (min, max, min + 1), then arbitrary models. Each model found is blocked on
+ * the bytes the condition reads, so every testcase differs where it matters.
+ */
+void TICooperator::generateDiverseSolutions(S2EExecutionState *state,
+                                            const klee::ref<klee::Expr> &branchCondition,
+                                            const ArrayVec &symbObjects,
+                                            const std::vector<std::vector<unsigned char>> &firstModel,
+                                            uint64_t ret_addr,
+                                            unsigned int cmpId,
+                                            unsigned solutions) {
+    std::vector<klee::ref<klee::Expr>> slice;
+    std::set<SymbolicByte> bytes;
+    sliceConstraints(pathConstraints(state), branchCondition, m_symbolicBytesCache, slice, bytes);
+
+    ConstraintManager session(slice);
+    session.addConstraint(branchCondition);
+
+    std::vector<klee::ref<klee::ReadExpr>> reads;
+    klee::findReads(branchCondition, true, reads);
+
+    std::map<const Array *, unsigned> objectIndex;
+    for (unsigned i = 0; i < symbObjects.size(); i++) {
+        objectIndex[symbObjects[i]] = i;
+    }
+
+    // false when no byte of the condition can be pinned, e.g. symbolic
+    // indices only. That depends on the reads alone, so the first model
+    // decides it for the whole loop.
+    auto block = [&](const std::vector<std::vector<unsigned char>> &model) {
+        klee::ref<klee::Expr> clause = ConstantExpr::create(0, Expr::Bool);
+        bool pinned = false;
+        for (const auto &r : reads) {
+            auto index = dyn_cast<ConstantExpr>(r->index);
+            auto oi = objectIndex.find(r->updates.root);
+            if (!index || oi == objectIndex.end()) {
+                continue;
+            }
+            unsigned char value = model[oi->second][index->getZExtValue()];
+            clause = OrExpr::create(clause, NeExpr::create(r, ConstantExpr::create(value, Expr::Int8)));
+            pinned = true;
         }
+        if (pinned) {
+            session.addConstraint(clause);
+        }
+        return pinned;
+    };
+
+    if (!block(firstModel)) {
+        return;
     }
-    
-    S2EExecutionState *newState = static_cast<S2EExecutionState *>(branchedState);
-    char idStr[32];
-    std::snprintf(idStr, 32, "/id:%06u-%lx-%u", newState->getID() - 1, ret_addr, cmpId);
 
-    // generate concrete input through branched state condition
-    m_TestCaseGenerator->generateTestCases(newState, std::string(idStr), testcases::TestCaseType::TC_FILE);
-    
-    // release branched state
-    delete branchedState;
+    auto solver = state->solver();
+    std::vector<klee::ref<klee::Expr>> hints;
+    auto operand = comparisonOperand(branchCondition);
+    if (!operand.isNull()) {
+        double start = klee::util::getWallTime();
+        auto range = solver->getRange(klee::Query(session, operand));
+        chargeSolver(bytes, klee::util::getWallTime() - start);
+        auto min = dyn_cast<ConstantExpr>(range.first);
+        auto max = dyn_cast<ConstantExpr>(range.second);
+        if (min && max) {
+            Expr::Width width = operand->getWidth();
+            hints.push_back(EqExpr::create(operand, ConstantExpr::create(min->getZExtValue(), width)));
+            hints.push_back(EqExpr::create(operand, ConstantExpr::create(max->getZExtValue(), width)));
+            // min + 1 would not fit the operand when the range is a single value
+            if (min->getZExtValue() != max->getZExtValue()) {
+                hints.push_back(EqExpr::create(operand, ConstantExpr::create(min->getZExtValue() + 1, width)));
+            }
+        }
+    }
+
+    unsigned count = 1;
+    unsigned nextHint = 0;
+    while (count < solutions) {
+        std::vector<std::vector<unsigned char>> model;
+        bool sat;
+        bool usedHint = nextHint < hints.size();
+
+        constraintsCount++;
+        double start = klee::util::getWallTime();
+        if (usedHint) {
+            ConstraintManager hinted(session);
+            hinted.addConstraint(hints[nextHint++]);
+            sat = solver->getInitialValues(klee::Query(hinted, ConstantExpr::alloc(0, Expr::Bool)), symbObjects, model);
+        } else {
+            sat = solver->getInitialValues(klee::Query(session, ConstantExpr::alloc(0, Expr::Bool)), symbObjects, model);
+        }
+        chargeSolver(bytes, klee::util::getWallTime() - start);
+
+        if (!sat) {
+            unsolvedConstraints++;
+            // an infeasible boundary says nothing about the rest of the region
+            if (usedHint) {
+                continue;
+            }
+            break;
+        }
+        solvedConstraints++;
+
+        // keep the blocking clauses too, or minimizing would undo them
+        if (m_minimizeTestcases) {
+            std::vector<klee::ref<klee::Expr>> constraints(session.begin(), session.end());
+            minimizeModel(state, constraints, bytes, symbObjects, model);
+        } else {
+            mergeSliceModel(state, bytes, symbObjects, model);
+        }
+        block(model);
+
+        char tag[16];
+        std::snprintf(tag, sizeof(tag), "div%u", count);
+        generateTestcase(state, branchCondition, symbObjects, model, ret_addr, cmpId, tag);
+        count++;
+    }
+
+    m_solutionCounts[ret_addr] += count - 1;
 }
 
-void TICooperator::initTestcaseDirectory() {
-    dirPath = s2e()->getOutputDirectory() + "/testcase-";
-    std::error_code mkdirError = llvm::sys::fs::create_directories(dirPath);
-    if (mkdirError) {
-        s2e()->getDebugStream() << "Could not create testcase directory " << dirPath << " error: " << mkdirError.message()
-                  << "\n";
-        exit(-1);
+/**
+ * The non-constant side of a comparison against a constant, looking through
+ * klee's (Eq false x) negations; null for any other shape.
+ */
+klee::ref<klee::Expr> TICooperator::comparisonOperand(const klee::ref<klee::Expr> &condition) {
+    klee::ref<klee::Expr> e = condition;
+    while (e->getKind() == Expr::Eq && isa<ConstantExpr>(e->getKid(0)) && e->getKid(1)->getWidth() == Expr::Bool) {
+        e = e->getKid(1);
     }
-    mode_t m = umask(0);
-    umask(m);
-    chmod(dirPath.c_str(), 0775 & ~m);
+
+    switch (e->getKind()) {
+        case Expr::Eq:
+        case Expr::Ne:
+        case Expr::Ult:
+        case Expr::Ule:
+        case Expr::Ugt:
+        case Expr::Uge:
+        case Expr::Slt:
+        case Expr::Sle:
+        case Expr::Sgt:
+        case Expr::Sge:
+            break;
+        default:
+            return klee::ref<klee::Expr>();
+    }
+
+    if (isa<ConstantExpr>(e->getKid(0)) && !isa<ConstantExpr>(e->getKid(1))) {
+        return e->getKid(1);
+    }
+    if (isa<ConstantExpr>(e->getKid(1)) && !isa<ConstantExpr>(e->getKid(0))) {
+        return e->getKid(0);
+    }
+    return klee::ref<klee::Expr>();
 }
 
-void TICooperator::readSelectedRetAddr() {
-    std::ifstream ifs("ret_addr");
-    size_t instRetAddr;
-    unsigned int cmpId;
-    if (!ifs) {
-        s2e()->getDebugStream() << "Unable to open ret_addr\n";
+/// Resets every byte outside the slice to its current concolic value.
+void TICooperator::mergeSliceModel(S2EExecutionState *state,
+                                   const std::set<SymbolicByte> &bytes,
+                                   const ArrayVec &symbObjects,
+                                   std::vector<std::vector<unsigned char>> &concreteObjects) {
+    for (unsigned i = 0; i < symbObjects.size(); i++) {
+        const Array *array = symbObjects[i];
+        if (bytes.count(SymbolicByte(array, ANY_BYTE))) {
+            continue;
+        }
+
+        const auto &seed = state->concolics->bindings[array];
+        auto &values = concreteObjects[i];
+        for (unsigned j = 0; j < values.size() && j < seed.size(); j++) {
+            if (!bytes.count(SymbolicByte(array, j))) {
+                values[j] = seed[j];
+            }
+        }
     }
-    while(!ifs.eof()) {
-        ifs >> std::hex >> instRetAddr >> std::dec >> cmpId;
-        retAddr.emplace(std::make_pair(instRetAddr, cmpId));
+}
+
+/**
+ * memcmp/strcmp/strncmp compare byte by byte, so flipping their outcome from
+ * the forks inside them takes one query per byte. When the return address of
+ * a call to one of the configured comparison functions is a TI target, the
+ * call is modeled instead: the whole comparison becomes one equality query
+ * over both buffers, solved once, right before the call executes.
+ */
+void TICooperator::onTranslateBlockEnd(ExecutionSignal *signal,
+                                       S2EExecutionState *state,
+                                       TranslationBlock *tb,
+                                       uint64_t pc,
+                                       bool staticTarget,
+                                       uint64_t staticTargetPc) {
+    if (tb->se_tb_type != TB_CALL || !staticTarget) {
+        return;
     }
-    ifs.close();
+
+    auto model = m_comparisonModels.find(staticTargetPc);
+    if (model == m_comparisonModels.end()) {
+        return;
+    }
+
+    auto target = findTarget(tb->pc + tb->size);
+    if (target == retAddr.end()) {
+        return;
+    }
+
+    signal->connect(sigc::bind(sigc::mem_fun(*this, &TICooperator::onComparisonCall), model->second, target->first,
+                               target->second));
 }
 
-void TICooperator::onSymbolicAddress(S2EExecutionState *state,
-                                           klee::ref<klee::Expr> symbolicAddress,
-                                           uint64_t concreteAddress,
-                                           bool &concretize,
-                                           CorePlugin::symbolicAddressReason reason) {
-    if (reason == CorePlugin::symbolicAddressReason::MEMORY) {
+void TICooperator::onComparisonCall(S2EExecutionState *state,
+                                    uint64_t pc,
+                                    ComparisonFunction function,
+                                    uint64_t ret_addr,
+                                    unsigned int cmpId) {
+    if (m_resumedTargets.count(ret_addr) || !inSolvingScope(pc)) {
+        return;
+    }
 
-        s2e()->getDebugStream() << "SymbolicAddress: " << hexval(concreteAddress) << "\n";
-        // off­-by-­one byte   
-        // try to solve concreteAddress + 1
-        uint64_t value = concreteAddress + 1;
-        auto constraint = EqExpr::create(symbolicAddress, ConstantExpr::create(value, Expr::Int64));
-        
-        // add constraint
-        if (!state->addConstraint(constraint, true)) {
-        
-            s2e()->getDebugStream() << "Cannot add constraint\n";
+    uint64_t lhsPtr, rhsPtr, count;
+    if (state->getPointerSize() == 8) {
+        // System V AMD64 argument registers
+        lhsPtr = state->regs()->read<uint64_t>(CPU_OFFSET(regs[R_EDI]));
+        rhsPtr = state->regs()->read<uint64_t>(CPU_OFFSET(regs[R_ESI]));
+        count = state->regs()->read<uint64_t>(CPU_OFFSET(regs[R_EDX]));
+    } else {
+        // i386 cdecl, the call has not pushed the return address yet
+        uint32_t args[3];
+        uint64_t sp = state->regs()->getSp();
+        if (!state->mem()->read(sp, args, sizeof(args))) {
+            getDebugStream(state) << "could not read the comparison arguments at " << hexval(pc) << "\n";
             return;
-        
-        } 
+        }
+        lhsPtr = args[0];
+        rhsPtr = args[1];
+        count = args[2];
+    }
 
-        s2e()->getDebugStream() << "Constraint solved\n";
-        std::vector<std::pair<std::string, std::vector<unsigned char>>> solution;
-        const std::pair<std::string, std::vector<unsigned char>> vp = solution[0];
+    uint64_t length = m_maxComparisonLength;
+    if (function != COMPARISON_STRCMP) {
+        length = std::min(length, count);
+    }
 
-        // solve
-        if (!state->getSymbolicSolution(solution)) {
-            
-            s2e()->getDebugStream() << "Cannot solve constraint\n";
-            return;   
-        
+    klee::ref<klee::Expr> equal = ConstantExpr::create(1, Expr::Bool);
+    std::string lhsToken, rhsToken;
+    bool lhsConstant = true, rhsConstant = true;
+
+    for (uint64_t i = 0; i < length; i++) {
+        auto lhs = state->mem()->read(lhsPtr + i, Expr::Int8);
+        auto rhs = state->mem()->read(rhsPtr + i, Expr::Int8);
+        if (lhs.isNull() || rhs.isNull()) {
+            break;
+        }
+
+        equal = AndExpr::create(equal, EqExpr::create(lhs, rhs));
+
+        auto lhsValue = dyn_cast<ConstantExpr>(lhs);
+        auto rhsValue = dyn_cast<ConstantExpr>(rhs);
+        lhsConstant = lhsConstant && lhsValue;
+        rhsConstant = rhsConstant && rhsValue;
+
+        // strings end at the terminator of whichever side is concrete,
+        // the terminator itself is part of the equality
+        bool terminated = (lhsValue && lhsValue->isZero()) || (rhsValue && rhsValue->isZero());
+        if (function != COMPARISON_MEMCMP && terminated) {
+            break;
         }
 
-        std::string input;
-        for (const auto __byte : vp.second) {
-            input.push_back(__byte);
+        // with both sides symbolic, end the strings where the seed does and
+        // pin the terminator, the bytes past it do not take part
+        if (function != COMPARISON_MEMCMP && !lhsValue && !rhsValue) {
+            auto seed = dyn_cast<ConstantExpr>(state->concolics->evaluate(lhs));
+            if (seed && seed->isZero()) {
+                equal = AndExpr::create(equal, EqExpr::create(lhs, ConstantExpr::create(0, Expr::Int8)));
+                break;
+            }
         }
 
-        // Write the solved input to the file.
-        /*std::string filename = "exploit.bin";
-        std::statOfstream ofs(filename);
-        ofs << input;*/
-        
+        if (lhsValue) {
+            lhsToken.push_back(lhsValue->getZExtValue(8));
+        }
+        if (rhsValue) {
+            rhsToken.push_back(rhsValue->getZExtValue(8));
+        }
+    }
+
+    if (lhsConstant && !lhsToken.empty()) {
+        addDictionaryToken(lhsToken);
+    }
+    if (rhsConstant && !rhsToken.empty()) {
+        addDictionaryToken(rhsToken);
+    }
+
+    equal = state->simplifyExpr(equal);
+    if (isa<ConstantExpr>(equal)) {
+        return;
+    }
+
+    // the seed already passes the comparison, nothing to flip
+    auto seedResult = dyn_cast<ConstantExpr>(state->concolics->evaluate(equal));
+    if (seedResult && seedResult->isTrue()) {
         return;
-    
+    }
+
+    isStepped.emplace(ret_addr);
+    m_modeledTargets.insert(ret_addr);
+    m_modeledComparisons++;
+
+    ArrayVec symbObjects = state->symbolics;
+    std::vector<std::vector<unsigned char>> concreteObjects;
+
+    constraintsCount++;
+    if (!solveBranch(state, equal, symbObjects, concreteObjects, ret_addr)) {
+        unsolvedConstraints++;
+        return;
+    }
+
+    solvedConstraints++;
+    generateTestcase(state, equal, symbObjects, concreteObjects, ret_addr, cmpId, "cmp");
+}
+
+/// Appends a token to the AFL dictionary, once per distinct value.
+void TICooperator::addDictionaryToken(const std::string &token) {
+    if (!m_dictOfs || !m_dictTokens.insert(token).second) {
+        return;
+    }
+
+    std::stringstream ss;
+    for (unsigned char c : token) {
+        if (c == '"' || c == '\\') {
+            ss << '\\' << c;
+        } else if (c >= 0x20 && c < 0x7f) {
+            ss << c;
+        } else {
+            char hex[5];
+            std::snprintf(hex, sizeof(hex), "\\x%02x", c);
+            ss << hex;
+        }
+    }
+
+    *m_dictOfs << "ticoop_" << m_dictTokens.size() << "=\"" << ss.str() << "\"\n";
+    m_dictOfs->flush();
+}
+
+bool TICooperator::computeAddressBounds(S2EExecutionState *state,
+                                        const klee::ref<klee::Expr> &address,
+                                        AddressBounds &bounds) {
+    // only the constraints on the bytes the address reads can bound it
+    std::vector<klee::ref<klee::Expr>> slice;
+    std::set<SymbolicByte> bytes;
+    sliceConstraints(state->constraints(), address, m_symbolicBytesCache, slice, bytes);
+
+    ConstraintManager constraints(slice);
+    auto range = state->solver()->getRange(klee::Query(constraints, address));
+
+    auto min = dyn_cast<ConstantExpr>(range.first);
+    auto max = dyn_cast<ConstantExpr>(range.second);
+    if (!min || !max) {
+        return false;
+    }
+
+    bounds.min = min->getZExtValue();
+    bounds.max = max->getZExtValue();
+    return true;
+}
+
+void TICooperator::emitAddressTestcases(S2EExecutionState *state,
+                                        const klee::ref<klee::Expr> &address,
+                                        uint64_t concreteAddress,
+                                        const AddressBounds &bounds,
+                                        uint64_t pc) {
+    if (!m_addressEmitTestcases) {
+        return;
+    }
+
+    auto emit = [&](uint64_t value, const char *kind) {
+        if (value == concreteAddress) {
+            return;
+        }
+
+        bool outOfBounds = value > concreteAddress ? value - concreteAddress > m_addressWindow
+                                                   : concreteAddress - value > m_addressWindow;
+
+        auto target = EqExpr::create(address, ConstantExpr::create(value, address->getWidth()));
+        ArrayVec symbObjects = state->symbolics;
+        std::vector<std::vector<unsigned char>> concreteObjects;
+
+        constraintsCount++;
+        if (!solveBranch(state, target, symbObjects, concreteObjects)) {
+            unsolvedConstraints++;
+            return;
+        }
+
+        solvedConstraints++;
+        std::string tag = std::string(outOfBounds ? "oob-" : "addr-") + kind;
+        generateTestcase(state, target, symbObjects, concreteObjects, pc, siteCmpId(pc), tag);
+    };
+
+    emit(bounds.min, "min");
+    if (bounds.max != bounds.min) {
+        emit(bounds.max, "max");
     }
 }
 
@@ -410,6 +3730,22 @@ void TICooperator::handleOpcodeInvocation(S2EExecutionState *state, uint64_t gue
 {
     S2E_TICooperator_COMMAND command;
 
+    // guests built against the unversioned header can still print statistics
+    if (guestDataSize == sizeof(S2E_TICooperator_COMMAND_V0)) {
+        S2E_TICooperator_COMMAND_V0 legacy;
+        if (!state->mem()->read(guestDataPtr, &legacy, guestDataSize)) {
+            getWarningsStream(state) << "could not read transmitted data\n";
+            return;
+        }
+        if (legacy.Command == TICOOP_PRINT_STATISTICS) {
+            printStatistics();
+        } else {
+            getWarningsStream(state) << "unversioned command " << legacy.Command
+                                     << ", rebuild the guest against TICooperatorCommands.h\n";
+        }
+        return;
+    }
+
     if (guestDataSize != sizeof(command)) {
         getWarningsStream(state) << "mismatched S2E_TICooperator_COMMAND size\n";
         return;
@@ -420,10 +3756,44 @@ void TICooperator::handleOpcodeInvocation(S2EExecutionState *state, uint64_t gue
         return;
     }
 
+    if (command.Version != TICOOP_COMMAND_VERSION) {
+        getWarningsStream(state) << "S2E_TICooperator_COMMAND version " << command.Version << ", expected "
+                                 << TICOOP_COMMAND_VERSION << "\n";
+        return;
+    }
+
     switch (command.Command) {
-        // TODO: add custom commands here
         case TICOOP_PRINT_STATISTICS: {
-            onTimer();
+            printStatistics();
+            break;
+        }
+        case TICOOP_SET_TIMEOUT: {
+            m_timeout = command.Timeout;
+            getDebugStream(state) << "timeout set to " << m_timeout << "s\n";
+            break;
+        }
+        case TICOOP_SET_BUDGET: {
+            setBudget(state, command.Budget.Kind, command.Budget.Value);
+            break;
+        }
+        case TICOOP_DISABLE_REGION: {
+            disableRegion(command.Region.Start, command.Region.End);
+            break;
+        }
+        case TICOOP_ENABLE_REGION: {
+            enableRegion(command.Region.Start, command.Region.End);
+            break;
+        }
+        case TICOOP_PHASE_BEGIN: {
+            beginPhase();
+            break;
+        }
+        case TICOOP_PHASE_END: {
+            endPhase();
+            break;
+        }
+        case TICOOP_GET_COUNTERS: {
+            writeCounters(state, command.Counters.Buffer, command.Counters.Size);
             break;
         }
         default:
@@ -28,25 +28,115 @@
 #include <s2e/Plugins/ExecutionTracers/TestCaseGenerator.h>
 #include <s2e/Plugins/OSMonitors/Linux/LinuxMonitor.h>
 
+#include <klee/util/ExprHashMap.h>
+
+#include <array>
+
+#include "TICooperatorCheckpoint.h"
+#include "TICooperatorCommands.h"
+#include "TICooperatorCostModel.h"
+#include "TICooperatorFeedback.h"
+#include "TICooperatorMemory.h"
+#include "TICooperatorPortfolio.h"
+#include "TICooperatorQueryCache.h"
+#include "TICooperatorTestcasePipeline.h"
+
 
 namespace s2e {
 namespace plugins {
 
+// (array, byte index) of a symbolic input byte
+typedef std::pair<const klee::Array *, uint32_t> SymbolicByte;
 
-enum S2E_TICooperator_COMMANDS {
-    // TODO: customize list of commands here
-    TICOOP_PRINT_STATISTICS,
+typedef LRUCache<klee::ref<klee::Expr>, std::set<SymbolicByte>, klee::util::ExprHash, klee::util::ExprCmp>
+    SymbolicBytesCache;
+
+enum SymbolicAddressPolicy {
+    ADDRESS_POLICY_NONE,
+    ADDRESS_POLICY_CONCOLIC,
+    ADDRESS_POLICY_SYMBOLIC,
+    ADDRESS_POLICY_RANGE,
 };
 
-struct S2E_TICooperator_COMMAND {
-    S2E_TICooperator_COMMANDS Command;
-    union {
-        // Command parameters go here
-        uint64_t param;
-    };
+enum ComparisonFunction {
+    COMPARISON_MEMCMP,
+    COMPARISON_STRCMP,
+    COMPARISON_STRNCMP,
+};
+
+enum DivergencePolicy {
+    DIVERGENCE_OFF,
+    DIVERGENCE_TAG,
+    DIVERGENCE_DROP,
+};
+
+enum BranchShape {
+    SHAPE_SINGLE_BYTE_EQ,
+    SHAPE_MULTI_BYTE_EQ,
+    SHAPE_RANGE,
+    SHAPE_ARITHMETIC,
+    SHAPE_MULDIV,
+    SHAPE_OTHER,
+    SHAPE_COUNT,
+};
+
+enum ExprBudgetFallback {
+    FALLBACK_OPTIMISTIC,
+    FALLBACK_CONCRETIZE,
+    FALLBACK_DUMP,
+    FALLBACK_COUNT,
+};
+
+enum DeadlineClock {
+    DEADLINE_USER,
+    DEADLINE_CPU,
+    DEADLINE_WALL,
+};
+
+struct ShapeStats {
+    unsigned queries;
+    unsigned fastPath;
+    double time;
+};
+
+struct ByteCost {
+    unsigned queries;
+    double time;
+    double share;
+};
+
+struct AddressBounds {
+    uint64_t min;
+    uint64_t max;
+};
+
+// a fork-decide query held back until the next batch flush
+struct BatchQuery {
+    klee::ref<klee::Expr> condition;
+    uint64_t retAddr;
+    unsigned int cmpId;
+    // concolic values when the query was raised, shared by consecutive
+    // queries while they do not change
+    klee::AssignmentPtr seed;
 };
 
+// one node per path constraint; queries hang off the prefix they were raised
+// under. Children are indices into the trie vector, so a path of thousands of
+// constraints is freed without recursing.
+struct BatchNode {
+    klee::ref<klee::Expr> constraint;
+    std::vector<unsigned> children;
+    std::vector<BatchQuery> queries;
+};
+
+// keyed by pc and address expression hash
+typedef LRUCache<uint64_t, AddressBounds> AddressBoundsCache;
 
+// branch condition -> cores, matched by expression equality rather than by
+// hash alone, a collision must not make a feasible target look unsat
+typedef LRUCache<klee::ref<klee::Expr>, std::vector<std::vector<klee::ref<klee::Expr>>>, klee::util::ExprHash,
+                 klee::util::ExprCmp>
+    UnsatCoreStore;
 
 class TICooperator : public Plugin, public IPluginInvoker {
     S2E_PLUGIN
@@ -68,6 +158,182 @@ private:
     std::map<uint64_t, unsigned int> retAddr;
     std::set<uint64_t> isStepped;
 
+    // checkpoint / resume
+    CheckpointWriter *m_checkpointWriter;
+    std::string m_checkpointFile;
+    double m_checkpointInterval;
+    double m_lastCheckpoint;
+    std::set<uint64_t> m_resumedTargets;
+
+    // cross-run query cache
+    PersistentQueryCache *m_queryCache;
+    std::ofstream *m_queryCacheOfs;
+    double m_solverTime;
+    unsigned m_solverCalls;
+    double m_cacheSavedTime;
+
+    // memory accounting of plugin-owned containers
+    MemoryAccounting m_memory;
+    MemoryPool *m_targetsPool;
+    MemoryPool *m_temporariesPool;
+    MemoryPool *m_dictionaryPool;
+    MemoryPool *m_edgeMapPool;
+    MemoryPool *m_feedbackPool;
+    MemoryPool *m_pipelinePool;
+    MemoryPool *m_symbolicBytesPool;
+    SymbolicBytesCache *m_symbolicBytesCache;
+    std::set<std::string> m_memoryWarned;
+
+    // symbolic address policy
+    SymbolicAddressPolicy m_addressPolicy;
+    uint64_t m_addressMaxRange;
+    uint64_t m_addressWindow;
+    bool m_addressEmitTestcases;
+    MemoryPool *m_addressBoundsPool;
+    AddressBoundsCache *m_addressBoundsCache;
+    unsigned m_symbolicAddresses;
+    unsigned m_addressBoundsHits;
+
+    // symbolic jump targets
+    unsigned m_jumpTargetBudget;
+    unsigned m_jumpTargetsFound;
+    std::map<uint64_t, std::set<uint64_t>> m_jumpTargets;
+    std::set<uint64_t> m_exhaustedJumps;
+
+    // memcmp/strcmp/strncmp models
+    std::map<uint64_t, ComparisonFunction> m_comparisonModels;
+    uint64_t m_maxComparisonLength;
+    unsigned m_modeledComparisons;
+    // targets solved at the comparison call, their post-call branch is not
+    std::set<uint64_t> m_modeledTargets;
+    std::ofstream *m_dictOfs;
+    std::set<std::string> m_dictTokens;
+
+    // diverse solutions per target
+    unsigned m_solutionsPerTarget;
+    std::map<uint64_t, unsigned> m_solutionCounts;
+
+    // divergence check, cmpId -> (checked, diverged)
+    enum DivergenceResult {
+        NO_DIVERGENCE,
+        DIVERGES_ON_PATH,
+        DIVERGES_ON_BRANCH,
+    };
+    DivergencePolicy m_divergencePolicy;
+    std::map<unsigned int, std::pair<unsigned, unsigned>> m_divergence;
+
+    // unsat core store, ret_addr -> queries skipped
+    MemoryPool *m_unsatCorePool;
+    UnsatCoreStore *m_unsatCores;
+    unsigned m_unsatCoreMinimize;
+    unsigned m_unsatCoreCount;
+    std::map<uint64_t, unsigned> m_coreSkips;
+
+    // branch shape routing
+    bool m_shapeRouting;
+    ShapeStats m_shapeStats[SHAPE_COUNT] = {};
+
+    // cutoff marker pc -> targets still reachable from it
+    std::map<uint64_t, std::vector<uint64_t>> m_cutoffMarkers;
+    uint64_t m_cutoffPc;
+    double m_cutoffTime;
+
+    // solver cost prediction, 0 budget disables
+    double m_costBudget;
+    unsigned m_costWarmup;
+    unsigned m_costExplore;
+    SolverCostModel m_costModel;
+    std::ofstream *m_costOfs;
+    unsigned m_overBudgetQueries;
+    unsigned m_deferredQueries;
+
+    // off-thread testcase assembly, nullptr writes through TestCaseGenerator
+    TestcasePipeline *m_pipeline;
+    unsigned m_testcaseId;
+
+    // stats sampling and the run deadline, both driven by onTimer
+    double m_startTime;
+    double m_statsInterval;
+    double m_lastSample;
+    std::ofstream *m_samplesOfs;
+    DeadlineClock m_deadlineClock;
+    bool m_deadlineReached;
+
+    bool m_heatmapEnabled;
+
+    // testcase minimization against the seed
+    bool m_minimizeTestcases;
+    unsigned m_minimizeBudget;
+    uint64_t m_minimizedBytes;
+    uint64_t m_keptBytes;
+
+    // guest controlled solving scope, see TICooperatorCommands.h
+    std::map<uint64_t, uint64_t> m_disabledRegions;
+    bool m_inPhase;
+    bool m_scopeToPhase;
+    // the one flag onStateForkDecide checks before doing any work
+    bool m_solvingEnabled;
+    std::set<uint64_t> m_phaseBeginPcs;
+    std::set<uint64_t> m_phaseEndPcs;
+    std::vector<std::pair<double, double>> m_phases;
+    uint64_t m_testcasesEmitted;
+    bool m_addressHookConnected;
+
+    // concretization of bytes no pending target depends on
+    bool m_concretizeNonCritical;
+    std::map<std::pair<std::string, uint32_t>, std::vector<uint64_t>> m_criticalBytes;
+    // external solvers raced on every solver query
+    SolverPortfolio m_portfolio;
+    double m_portfolioTimeout;
+    std::map<std::string, unsigned> m_portfolioWins[SHAPE_COUNT];
+    unsigned m_portfolioUnknown;
+    unsigned m_portfolioRejected;
+
+    // expression size budgets, 0 is unlimited
+    unsigned m_maxQueryNodes;
+    unsigned m_maxQueryDepth;
+    ExprBudgetFallback m_budgetFallback;
+    std::map<uint64_t, std::array<unsigned, FALLBACK_COUNT>> m_budgetFallbacks;
+
+    // pinned value and pc of the fork that first used the byte
+    std::map<SymbolicByte, std::pair<uint8_t, uint64_t>> m_concretized;
+    std::map<SymbolicByte, ByteCost> m_heatmap;
+
+    // prefix-sharing batch solving, m_batchTrie[0] is the root
+    bool m_batchSolving;
+    unsigned m_batchSize;
+    double m_batchInterval;
+    double m_lastBatchFlush;
+    S2EExecutionState *m_batchState;
+    std::vector<BatchNode> m_batchTrie;
+    unsigned m_batchPending;
+    klee::AssignmentPtr m_batchSeed;
+    uint64_t m_batchSeedBytes;
+    MemoryPool *m_batchPool;
+    // prefix the flushed query was raised under, nullptr outside a flush
+    const ConstraintManager *m_batchConstraints;
+    unsigned m_batchFlushes;
+    unsigned m_batchDuplicates;
+    uint64_t m_batchPrefixWalked;
+    uint64_t m_batchPrefixTotal;
+
+    // AFL edge bitmap of the concolic path, empty when disabled
+    std::vector<uint8_t> m_edgeMap;
+    uint64_t m_edgeStart;
+    uint64_t m_edgeEnd;
+    uint32_t m_edgePrevLoc;
+    uint8_t *m_edgeShm;
+    bool m_edgeMapWritten;
+
+    // fuzzer feedback on which targets' testcases pay off, nullptr disables
+    FuzzerFeedback *m_feedback;
+    double m_feedbackInterval;
+    double m_lastFeedbackPoll;
+    std::map<unsigned int, unsigned> m_feedbackSeen;
+    unsigned m_feedbackSkips;
+    // solver effort of the branch being solved, scales its time budgets
+    double m_effort;
+
     typedef std::pair<std::string, std::vector<unsigned char>> VarValuePair;
     typedef std::vector<VarValuePair> ConcreteInputs;
 
@@ -76,6 +342,69 @@ private:
     
     void onEngineShutdown();
     void onTimer();
+    void onStateKill(S2EExecutionState *state);
+    void enqueueBatch(S2EExecutionState *state,
+                      const klee::ref<klee::Expr> &branchCondition,
+                      uint64_t ret_addr,
+                      unsigned int cmpId);
+    void flushBatch();
+    void onEdgeTranslate(ExecutionSignal *signal,
+                         S2EExecutionState *state,
+                         TranslationBlock *tb,
+                         uint64_t pc);
+    void onEdgeBlock(S2EExecutionState *state, uint64_t pc, uint32_t loc);
+    void writeEdgeBitmap();
+    const ConstraintManager &pathConstraints(S2EExecutionState *state) const;
+    void processBranch(S2EExecutionState *state,
+                       const klee::ref<klee::Expr> &branchCondition,
+                       const std::vector<klee::ref<klee::Expr>> &slice,
+                       const std::set<SymbolicByte> &bytes,
+                       uint64_t ret_addr,
+                       unsigned int cmpId);
+    void reportMemory();
+    void sampleStats();
+    void printStatistics();
+    std::string solvingCounters() const;
+    bool solveOverBudget(S2EExecutionState *state,
+                         const klee::ref<klee::Expr> &branchCondition,
+                         const std::vector<klee::ref<klee::Expr>> &slice,
+                         const std::set<SymbolicByte> &bytes,
+                         const std::set<SymbolicByte> &conditionBytes,
+                         ArrayVec &symbObjects,
+                         std::vector<std::vector<unsigned char>> &concreteObjects,
+                         uint64_t ret_addr);
+    klee::ref<klee::Expr> shrinkExpr(S2EExecutionState *state, klee::ref<klee::Expr> e);
+    bool solveConstraints(S2EExecutionState *state,
+                          const std::vector<klee::ref<klee::Expr>> &constraints,
+                          ArrayVec &symbObjects,
+                          std::vector<std::vector<unsigned char>> &concreteObjects);
+    void readCriticalBytes(const std::string &path);
+    bool isCritical(const SymbolicByte &b) const;
+    klee::ref<klee::Expr> concretizeNonCritical(S2EExecutionState *state, const klee::ref<klee::Expr> &condition);
+    void beginPhase();
+    void endPhase();
+    void onPhaseTranslate(ExecutionSignal *signal,
+                          S2EExecutionState *state,
+                          TranslationBlock *tb,
+                          uint64_t pc);
+    void onPhaseMarker(S2EExecutionState *state, uint64_t pc);
+    void setBudget(S2EExecutionState *state, uint32_t kind, uint64_t value);
+    void disableRegion(uint64_t start, uint64_t end);
+    void enableRegion(uint64_t start, uint64_t end);
+    bool inDisabledRegion(uint64_t pc) const;
+    bool inSolvingScope(uint64_t pc) const;
+    void writeCounters(S2EExecutionState *state, uint64_t buffer, uint64_t size);
+    void connectAddressHook();
+    void minimizeModel(S2EExecutionState *state,
+                       const std::vector<klee::ref<klee::Expr>> &constraints,
+                       const std::set<SymbolicByte> &bytes,
+                       const ArrayVec &symbObjects,
+                       std::vector<std::vector<unsigned char>> &concreteObjects);
+    void chargeHeatmap(const std::set<SymbolicByte> &bytes, double seconds);
+    void chargeSolver(const std::set<SymbolicByte> &bytes, double seconds);
+    void writeHeatmap();
+    void checkDeadline();
+    std::map<uint64_t, unsigned int>::iterator findTarget(uint64_t pc);
     void onStateForkDecide(S2EExecutionState *state, 
                            const klee::ref<klee::Expr> &condition_, 
                            bool &allowForking);
@@ -84,14 +413,118 @@ private:
                            uint64_t concreteAddress,
                            bool &concretize,
                            CorePlugin::symbolicAddressReason reason);
+    bool solveBranch(S2EExecutionState *state,
+                     const klee::ref<klee::Expr> &branchCondition,
+                     ArrayVec &symbObjects,
+                     std::vector<std::vector<unsigned char>> &concreteObjects,
+                     uint64_t ret_addr = 0);
+    bool solveBranch(S2EExecutionState *state,
+                     const klee::ref<klee::Expr> &branchCondition,
+                     const std::vector<klee::ref<klee::Expr>> &slice,
+                     const std::set<SymbolicByte> &bytes,
+                     ArrayVec &symbObjects,
+                     std::vector<std::vector<unsigned char>> &concreteObjects,
+                     uint64_t ret_addr);
+    bool solveSliced(S2EExecutionState *state,
+                     const klee::ref<klee::Expr> &branchCondition,
+                     const std::vector<klee::ref<klee::Expr>> &slice,
+                     const std::set<SymbolicByte> &bytes,
+                     ArrayVec &symbObjects,
+                     std::vector<std::vector<unsigned char>> &concreteObjects,
+                     uint64_t ret_addr,
+                     BranchShape shape);
+    bool startPortfolio(const klee::Query &query, const ArrayVec &symbObjects, std::string &queryFile);
+    bool finishPortfolio(S2EExecutionState *state,
+                         const klee::Query &query,
+                         BranchShape shape,
+                         ArrayVec &symbObjects,
+                         std::vector<std::vector<unsigned char>> &concreteObjects,
+                         bool &answered);
+    static QueryFeatures queryFeatures(const std::vector<klee::ref<klee::Expr>> &slice,
+                                       const klee::ref<klee::Expr> &branchCondition,
+                                       const std::set<SymbolicByte> &bytes);
+    void dumpQuery(const ConstraintManager &constraints, uint64_t ret_addr);
+    static BranchShape classifyBranch(const klee::ref<klee::Expr> &condition, const std::set<SymbolicByte> &bytes);
+    bool solveSingleByte(S2EExecutionState *state,
+                         const klee::ref<klee::Expr> &branchCondition,
+                         const std::vector<klee::ref<klee::Expr>> &slice,
+                         const SymbolicByte &byte,
+                         ArrayVec &symbObjects,
+                         std::vector<std::vector<unsigned char>> &concreteObjects);
+    bool containsUnsatCore(const std::vector<klee::ref<klee::Expr>> &slice,
+                           const klee::ref<klee::Expr> &branchCondition);
+    void recordUnsatCore(S2EExecutionState *state,
+                         const std::vector<klee::ref<klee::Expr>> &slice,
+                         const klee::ref<klee::Expr> &branchCondition);
+    bool applyCachedModel(S2EExecutionState *state,
+                          const QueryCacheEntry &entry,
+                          const std::vector<klee::ref<klee::Expr>> &slice,
+                          const klee::ref<klee::Expr> &branchCondition,
+                          ArrayVec &symbObjects,
+                          std::vector<std::vector<unsigned char>> &concreteObjects);
+    void onTranslateBlockEnd(ExecutionSignal *signal,
+                             S2EExecutionState *state,
+                             TranslationBlock *tb,
+                             uint64_t pc,
+                             bool staticTarget,
+                             uint64_t staticTargetPc);
+    void onComparisonCall(S2EExecutionState *state,
+                          uint64_t pc,
+                          ComparisonFunction function,
+                          uint64_t ret_addr,
+                          unsigned int cmpId);
+    void addDictionaryToken(const std::string &token);
+    void onCutoffTranslate(ExecutionSignal *signal,
+                           S2EExecutionState *state,
+                           TranslationBlock *tb,
+                           uint64_t pc);
+    void onCutoffMarker(S2EExecutionState *state, uint64_t pc);
+    void readCutoffMarkers(const std::string &path);
+    void generateDiverseSolutions(S2EExecutionState *state,
+                                  const klee::ref<klee::Expr> &branchCondition,
+                                  const ArrayVec &symbObjects,
+                                  const std::vector<std::vector<unsigned char>> &firstModel,
+                                  uint64_t ret_addr,
+                                  unsigned int cmpId,
+                                  unsigned solutions);
+    static klee::ref<klee::Expr> comparisonOperand(const klee::ref<klee::Expr> &condition);
+    void enumerateJumpTargets(S2EExecutionState *state,
+                              const klee::ref<klee::Expr> &target,
+                              uint64_t concreteTarget);
+    void mergeSliceModel(S2EExecutionState *state,
+                         const std::set<SymbolicByte> &bytes,
+                         const ArrayVec &symbObjects,
+                         std::vector<std::vector<unsigned char>> &concreteObjects);
+    bool computeAddressBounds(S2EExecutionState *state,
+                              const klee::ref<klee::Expr> &address,
+                              AddressBounds &bounds);
+    void emitAddressTestcases(S2EExecutionState *state,
+                              const klee::ref<klee::Expr> &address,
+                              uint64_t concreteAddress,
+                              const AddressBounds &bounds,
+                              uint64_t pc);
+    void submitTestcase(S2EExecutionState *state,
+                        const ArrayVec &symbObjects,
+                        const std::vector<std::vector<unsigned char>> &concreteObjects,
+                        uint64_t ret_addr, unsigned int cmpId,
+                        const std::string &suffix);
     void generateTestcase(S2EExecutionState *state, 
-                          klee::ref<klee::Expr> &condition, 
-                          bool conditionIsTrue, 
-                          ArrayVec &symbObjects, 
-                          std::vector<std::vector<unsigned char>> &concreteObjects, 
-                          uint64_t ret_addr, unsigned int cmpId);
+                          const klee::ref<klee::Expr> &branchCondition, 
+                          const ArrayVec &symbObjects, 
+                          const std::vector<std::vector<unsigned char>> &concreteObjects, 
+                          uint64_t ret_addr, unsigned int cmpId,
+                          const std::string &tag = "");
+    DivergenceResult checkDivergence(S2EExecutionState *state,
+                                     const klee::ref<klee::Expr> &branchCondition,
+                                     const ArrayVec &symbObjects,
+                                     const std::vector<std::vector<unsigned char>> &model,
+                                     unsigned int cmpId);
     void initTestcaseDirectory();
     void readSelectedRetAddr();
+
+    std::string serializeCheckpoint();
+    bool loadCheckpoint();
+    void saveCheckpoint(bool sync);
   
 };
 
@@ -0,0 +1,257 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#include "TICooperatorCheckpoint.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+namespace {
+const uint32_t CHECKPOINT_MAGIC = 0x4b434954; // "TICK"
+const uint32_t CHECKPOINT_VERSION = 1;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SnapshotWriter::SnapshotWriter() : m_sectionStart(0) {
+    writeU32(CHECKPOINT_MAGIC);
+    writeU32(CHECKPOINT_VERSION);
+}
+
+void SnapshotWriter::beginSection(uint32_t tag) {
+    writeU32(tag);
+    // length is patched in endSection
+    writeU32(0);
+    m_sectionStart = m_data.size();
+}
+
+void SnapshotWriter::endSection() {
+    uint32_t length = m_data.size() - m_sectionStart;
+    std::memcpy(&m_data[m_sectionStart - sizeof(length)], &length, sizeof(length));
+}
+
+void SnapshotWriter::writeU8(uint8_t v) {
+    writeBytes(&v, sizeof(v));
+}
+
+void SnapshotWriter::writeU32(uint32_t v) {
+    writeBytes(&v, sizeof(v));
+}
+
+void SnapshotWriter::writeU64(uint64_t v) {
+    writeBytes(&v, sizeof(v));
+}
+
+void SnapshotWriter::writeDouble(double v) {
+    writeBytes(&v, sizeof(v));
+}
+
+void SnapshotWriter::writeBytes(const void *data, size_t size) {
+    m_data.append(static_cast<const char *>(data), size);
+}
+
+void SnapshotWriter::writeString(const std::string &s) {
+    writeU32(s.size());
+    writeBytes(s.data(), s.size());
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+SnapshotReader::SnapshotReader(const std::string &data)
+    : m_data(data), m_pos(0), m_sectionEnd(data.size()), m_valid(false) {
+    uint32_t magic, version;
+    if (readU32(magic) && readU32(version)) {
+        m_valid = magic == CHECKPOINT_MAGIC && version == CHECKPOINT_VERSION;
+    }
+    m_sectionEnd = m_pos;
+}
+
+bool SnapshotReader::nextSection(uint32_t &tag) {
+    // skip whatever the caller did not consume in the previous section
+    m_pos = m_sectionEnd;
+    m_sectionEnd = m_data.size();
+
+    uint32_t length;
+    if (!readU32(tag) || !readU32(length)) {
+        return false;
+    }
+
+    if (m_pos + length > m_data.size()) {
+        return false;
+    }
+
+    m_sectionEnd = m_pos + length;
+    return true;
+}
+
+bool SnapshotReader::readU8(uint8_t &v) {
+    return readBytes(&v, sizeof(v));
+}
+
+bool SnapshotReader::readU32(uint32_t &v) {
+    return readBytes(&v, sizeof(v));
+}
+
+bool SnapshotReader::readU64(uint64_t &v) {
+    return readBytes(&v, sizeof(v));
+}
+
+bool SnapshotReader::readDouble(double &v) {
+    return readBytes(&v, sizeof(v));
+}
+
+bool SnapshotReader::readBytes(void *data, size_t size) {
+    if (m_pos + size > m_sectionEnd) {
+        return false;
+    }
+    std::memcpy(data, m_data.data() + m_pos, size);
+    m_pos += size;
+    return true;
+}
+
+bool SnapshotReader::readString(std::string &s) {
+    uint32_t size;
+    if (!readU32(size) || m_pos + size > m_sectionEnd) {
+        return false;
+    }
+    s.assign(m_data.data() + m_pos, size);
+    m_pos += size;
+    return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+CheckpointWriter::CheckpointWriter(const std::string &path)
+    : m_path(path), m_hasPending(false), m_stop(false), m_generation(0), m_pendingGeneration(0), m_writtenGeneration(0), m_written(0) {
+    m_thread = std::thread(&CheckpointWriter::run, this);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread.join();
+}
+
+void CheckpointWriter::submit(const std::string &snapshot) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending = snapshot;
+        m_pendingGeneration = ++m_generation;
+        m_hasPending = true;
+    }
+    m_cond.notify_one();
+}
+
+bool CheckpointWriter::writeNow(const std::string &snapshot) {
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // the synchronous snapshot is newer than anything still queued
+        m_hasPending = false;
+        generation = ++m_generation;
+    }
+
+    std::lock_guard<std::mutex> fileLock(m_fileMutex);
+    return writeFile(snapshot, generation);
+}
+
+void CheckpointWriter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cond.wait(lock, [this] { return m_stop || m_hasPending; });
+        if (!m_hasPending) {
+            break;
+        }
+
+        std::string snapshot;
+        snapshot.swap(m_pending);
+        uint64_t generation = m_pendingGeneration;
+        m_hasPending = false;
+
+        // submit must not wait for the disk
+        lock.unlock();
+        {
+            std::lock_guard<std::mutex> fileLock(m_fileMutex);
+            writeFile(snapshot, generation);
+        }
+        lock.lock();
+    }
+}
+
+bool CheckpointWriter::writeFile(const std::string &snapshot, uint64_t generation) {
+    // a synchronous write may have overtaken an older queued snapshot
+    if (generation <= m_writtenGeneration) {
+        return true;
+    }
+
+    std::string tmpPath = m_path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t done = 0;
+    while (done < snapshot.size()) {
+        ssize_t ret = write(fd, snapshot.data() + done, snapshot.size() - done);
+        if (ret <= 0) {
+            close(fd);
+            return false;
+        }
+        done += ret;
+    }
+
+    fsync(fd);
+    close(fd);
+
+    if (rename(tmpPath.c_str(), m_path.c_str()) < 0) {
+        return false;
+    }
+
+    m_writtenGeneration = generation;
+    m_written++;
+    return true;
+}
+
+bool CheckpointWriter::load(const std::string &path, std::string &snapshot) {
+    std::ifstream ifs(path, std::ios::in | std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    snapshot = ss.str();
+    return true;
+}
+
+} // namespace plugins
+} // namespace s2e
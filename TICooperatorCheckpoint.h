@@ -0,0 +1,153 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#ifndef S2E_PLUGINS_TICooperatorCheckpoint_H
+#define S2E_PLUGINS_TICooperatorCheckpoint_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace s2e {
+namespace plugins {
+
+/**
+ * Checkpoint snapshot layout:
+ *
+ *   magic (u32) | version (u32) | { tag (u32) | length (u32) | payload }*
+ *
+ * Each piece of plugin state lives in its own tagged section, so a reader
+ * skips sections it does not know and new state can be appended without
+ * breaking older snapshots.
+ *
+ * Snapshotted are the solving counters, the stepped targets, the solutions
+ * found per target, the jump targets enumerated per jump site and the
+ * dictionary tokens. Deliberately left out are the solver-side caches
+ * (symbolic bytes, address bounds, unsat cores): they are keyed by
+ * expressions of the current run, and the memory-mapped query cache already
+ * persists solver results across runs.
+ */
+enum TICooperatorCheckpointSection : uint32_t {
+    TICOOP_CKPT_COUNTERS = 1,
+    TICOOP_CKPT_STEPPED = 2,
+    TICOOP_CKPT_SOLUTIONS = 3,
+    TICOOP_CKPT_JUMP_TARGETS = 4,
+    TICOOP_CKPT_DICT_TOKENS = 5,
+};
+
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+
+    void beginSection(uint32_t tag);
+    void endSection();
+
+    void writeU8(uint8_t v);
+    void writeU32(uint32_t v);
+    void writeU64(uint64_t v);
+    void writeDouble(double v);
+    void writeBytes(const void *data, size_t size);
+    void writeString(const std::string &s);
+
+    const std::string &data() const {
+        return m_data;
+    }
+
+private:
+    std::string m_data;
+    size_t m_sectionStart;
+};
+
+class SnapshotReader {
+public:
+    SnapshotReader(const std::string &data);
+
+    // false if the magic or version do not match
+    bool valid() const {
+        return m_valid;
+    }
+
+    // moves to the next section, false at the end of the snapshot
+    bool nextSection(uint32_t &tag);
+
+    bool readU8(uint8_t &v);
+    bool readU32(uint32_t &v);
+    bool readU64(uint64_t &v);
+    bool readDouble(double &v);
+    bool readBytes(void *data, size_t size);
+    bool readString(std::string &s);
+
+private:
+    const std::string &m_data;
+    size_t m_pos;
+    size_t m_sectionEnd;
+    bool m_valid;
+};
+
+/**
+ * Writes snapshots off the emulation thread.
+ *
+ * submit() only hands the serialized buffer over; a newer snapshot replaces
+ * a pending one that was not written yet. Files are written to a temporary
+ * name and renamed, so a crash while writing never leaves a torn checkpoint.
+ */
+class CheckpointWriter {
+public:
+    CheckpointWriter(const std::string &path);
+    ~CheckpointWriter();
+
+    void submit(const std::string &snapshot);
+
+    // write synchronously, used on shutdown
+    bool writeNow(const std::string &snapshot);
+
+    unsigned written() const {
+        return m_written;
+    }
+
+    static bool load(const std::string &path, std::string &snapshot);
+
+private:
+    std::string m_path;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::mutex m_fileMutex;
+    std::condition_variable m_cond;
+    std::string m_pending;
+    bool m_hasPending;
+    bool m_stop;
+    uint64_t m_generation;
+    uint64_t m_pendingGeneration;
+    uint64_t m_writtenGeneration;
+    std::atomic<unsigned> m_written;
+
+    void run();
+    bool writeFile(const std::string &snapshot, uint64_t generation);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorCheckpoint_H
@@ -0,0 +1,97 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_TICooperatorCommands_H
+#define S2E_PLUGINS_TICooperatorCommands_H
+
+// Shared by the plugin and guest/ticoopcmd.c, so it must stay plain C.
+
+#include <stdint.h>
+
+// Bumped whenever S2E_TICooperator_COMMAND changes layout. The plugin only
+// accepts its own version, and the layout from before versioning.
+#define TICOOP_COMMAND_VERSION 1
+
+typedef enum S2E_TICooperator_COMMANDS {
+    TICOOP_PRINT_STATISTICS,
+    // Timeout: seconds on the configured timeoutClock
+    TICOOP_SET_TIMEOUT,
+    // Budget
+    TICOOP_SET_BUDGET,
+    // Region: no solving for forks in [Start, End)
+    TICOOP_DISABLE_REGION,
+    // Region: undo TICOOP_DISABLE_REGION for [Start, End)
+    TICOOP_ENABLE_REGION,
+    // mark the input-processing phase
+    TICOOP_PHASE_BEGIN,
+    TICOOP_PHASE_END,
+    // Counters: fill a guest S2E_TICooperator_COUNTERS buffer
+    TICOOP_GET_COUNTERS,
+} S2E_TICooperator_COMMANDS;
+
+typedef enum S2E_TICooperator_BUDGETS {
+    TICOOP_BUDGET_SOLUTIONS,
+    TICOOP_BUDGET_JUMP_TARGETS,
+    TICOOP_BUDGET_MINIMIZE,
+} S2E_TICooperator_BUDGETS;
+
+typedef struct S2E_TICooperator_COUNTERS {
+    uint64_t Constraints;
+    uint64_t Solved;
+    uint64_t Unsolved;
+    uint64_t Targets;
+    uint64_t Stepped;
+    uint64_t Testcases;
+    uint64_t SolverMicroseconds;
+    uint64_t InPhase;
+} __attribute__((packed)) S2E_TICooperator_COUNTERS;
+
+typedef struct S2E_TICooperator_COMMAND {
+    uint32_t Version;
+    S2E_TICooperator_COMMANDS Command;
+    union {
+        uint64_t param;
+        uint64_t Timeout;
+        struct {
+            uint32_t Kind;
+            uint64_t Value;
+        } __attribute__((packed)) Budget;
+        struct {
+            uint64_t Start;
+            uint64_t End;
+        } __attribute__((packed)) Region;
+        struct {
+            uint64_t Buffer;
+            uint64_t Size;
+        } __attribute__((packed)) Counters;
+    };
+} __attribute__((packed)) S2E_TICooperator_COMMAND;
+
+// unversioned layout of the original header, which only had
+// TICOOP_PRINT_STATISTICS
+typedef struct S2E_TICooperator_COMMAND_V0 {
+    S2E_TICooperator_COMMANDS Command;
+    uint64_t param;
+} S2E_TICooperator_COMMAND_V0;
+
+#endif // S2E_PLUGINS_TICooperatorCommands_H
@@ -0,0 +1,126 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_TICooperatorCostModel_H
+#define S2E_PLUGINS_TICooperatorCostModel_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+namespace s2e {
+namespace plugins {
+
+// Cheap features of a sliced branch query.
+struct QueryFeatures {
+    unsigned constraints;
+    unsigned nodes;
+    unsigned bytes;
+    bool mulDiv;
+    bool shift;
+};
+
+/**
+ * Predicts solver time from query features with a linear model over
+ * log-scaled features, fitted to log seconds by recursive least squares.
+ * The forgetting factor lets the fit follow the target as the path and
+ * the solver's caches change over a run.
+ */
+class SolverCostModel {
+public:
+    static const unsigned N = 6;
+
+    SolverCostModel(double forgetting = 0.99) : m_forgetting(forgetting), m_observations(0) {
+        for (unsigned i = 0; i < N; i++) {
+            m_weights[i] = 0;
+            for (unsigned j = 0; j < N; j++) {
+                m_p[i][j] = i == j ? 1000.0 : 0.0;
+            }
+        }
+    }
+
+    double predict(const QueryFeatures &f) const {
+        double x[N];
+        vectorize(f, x);
+        double y = 0;
+        for (unsigned i = 0; i < N; i++) {
+            y += m_weights[i] * x[i];
+        }
+        return std::exp(y);
+    }
+
+    void update(const QueryFeatures &f, double seconds) {
+        double x[N], px[N];
+        vectorize(f, x);
+
+        double denominator = m_forgetting;
+        double y = 0;
+        for (unsigned i = 0; i < N; i++) {
+            px[i] = 0;
+            for (unsigned j = 0; j < N; j++) {
+                px[i] += m_p[i][j] * x[j];
+            }
+            denominator += x[i] * px[i];
+            y += m_weights[i] * x[i];
+        }
+
+        double error = std::log(std::max(seconds, MIN_SECONDS)) - y;
+        for (unsigned i = 0; i < N; i++) {
+            m_weights[i] += px[i] / denominator * error;
+        }
+        for (unsigned i = 0; i < N; i++) {
+            for (unsigned j = 0; j < N; j++) {
+                m_p[i][j] = (m_p[i][j] - px[i] * px[j] / denominator) / m_forgetting;
+            }
+        }
+
+        m_observations++;
+    }
+
+    uint64_t observations() const {
+        return m_observations;
+    }
+
+private:
+    // timer resolution, keeps log() finite for cached answers
+    static constexpr double MIN_SECONDS = 1e-6;
+
+    double m_forgetting;
+    double m_weights[N];
+    double m_p[N][N];
+    uint64_t m_observations;
+
+    static void vectorize(const QueryFeatures &f, double x[N]) {
+        x[0] = 1.0;
+        x[1] = std::log1p(f.constraints);
+        x[2] = std::log1p(f.nodes);
+        x[3] = std::log1p(f.bytes);
+        x[4] = f.mulDiv ? 1.0 : 0.0;
+        x[5] = f.shift ? 1.0 : 0.0;
+    }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorCostModel_H
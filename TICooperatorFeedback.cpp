@@ -0,0 +1,147 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "TICooperatorFeedback.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+namespace s2e {
+namespace plugins {
+
+FuzzerFeedback::FuzzerFeedback(const std::string &feedbackPath, const std::string &statePath, double prior)
+    : m_feedbackPath(feedbackPath), m_statePath(statePath), m_prior(prior), m_offset(0), m_emitted(0),
+      m_productive(0) {
+}
+
+bool FuzzerFeedback::load() {
+    std::ifstream ifs(m_statePath);
+    if (!ifs) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(ifs, line)) {
+        std::istringstream ss(line);
+        std::string first;
+        ss >> first;
+        if (first == "offset") {
+            ss >> m_offset;
+            continue;
+        }
+
+        TargetPayoff payoff;
+        std::istringstream cmp(first);
+        unsigned cmpId;
+        if (!(cmp >> cmpId) || !(ss >> payoff.emitted >> payoff.productive)) {
+            continue;
+        }
+        m_payoff[cmpId] = payoff;
+        m_emitted += payoff.emitted;
+        m_productive += payoff.productive;
+    }
+    return true;
+}
+
+bool FuzzerFeedback::save() const {
+    // renamed into place, a crash never leaves a torn state file
+    std::string tmpPath = m_statePath + ".tmp";
+    std::ofstream ofs(tmpPath, std::ios::out | std::ios::trunc);
+    if (!ofs) {
+        return false;
+    }
+
+    ofs << "offset " << m_offset << "\n";
+    for (const auto &it : m_payoff) {
+        ofs << it.first << " " << it.second.emitted << " " << it.second.productive << "\n";
+    }
+    ofs.close();
+    if (!ofs) {
+        return false;
+    }
+
+    return std::rename(tmpPath.c_str(), m_statePath.c_str()) == 0;
+}
+
+unsigned FuzzerFeedback::poll() {
+    std::ifstream ifs(m_feedbackPath, std::ios::in | std::ios::binary);
+    if (!ifs) {
+        return 0;
+    }
+
+    ifs.seekg(0, std::ios::end);
+    uint64_t size = ifs.tellg();
+    if (size < m_offset) {
+        m_offset = 0;
+    }
+    ifs.seekg(m_offset);
+
+    unsigned productive = 0;
+    std::string line;
+    // a last line without its newline is still being written
+    while (std::getline(ifs, line) && !ifs.eof()) {
+        m_offset += line.size() + 1;
+
+        unsigned cmpId;
+        if (parseLine(line, cmpId)) {
+            m_payoff[cmpId].productive++;
+            m_productive++;
+            productive++;
+        }
+    }
+    return productive;
+}
+
+double FuzzerFeedback::weight(unsigned cmpId) const {
+    auto it = m_payoff.find(cmpId);
+    if (it == m_payoff.end()) {
+        return 1;
+    }
+
+    double rate = (m_productive + 1.0) / (m_emitted + 2.0);
+    double score = (it->second.productive + m_prior * rate) / (it->second.emitted + m_prior);
+    return std::min(4.0, std::max(0.25, score / rate));
+}
+
+bool FuzzerFeedback::parseLine(const std::string &line, unsigned &cmpId) {
+    std::istringstream ss(line);
+    std::string name, flag;
+    ss >> name >> flag;
+    if (flag == "0") {
+        return false;
+    }
+
+    // directory sink and AFL sync directory names
+    auto pos = name.find("id:");
+    if (pos == std::string::npos) {
+        return false;
+    }
+    const char *id = name.c_str() + pos;
+    return std::sscanf(id, "id:%*u-%*x-%u", &cmpId) == 1 ||
+           std::sscanf(id, "id:%*u,src:ticoop,ret:%*x,cmp:%u", &cmpId) == 1;
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,98 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_TICooperatorFeedback_H
+#define S2E_PLUGINS_TICooperatorFeedback_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+namespace s2e {
+namespace plugins {
+
+struct TargetPayoff {
+    uint64_t emitted;
+    uint64_t productive;
+};
+
+/**
+ * Per-cmpId payoff of the testcases handed to the fuzzer.
+ *
+ * The fuzzer appends one line per TICooperator testcase that gave it new
+ * coverage: the testcase name, optionally followed by 1 or 0.
+ *
+ *   id:000012-401a2c-7
+ *   id:000013,src:ticoop,ret:401a2c,cmp:7 1
+ *
+ * Each poll only reads what was appended since the previous one; a file
+ * that got shorter was rotated and is read from the start. Emitted and
+ * productive counts, and the offset read so far, are kept in a state file
+ * so that they carry over to the next S2E launch.
+ */
+class FuzzerFeedback {
+public:
+    FuzzerFeedback(const std::string &feedbackPath, const std::string &statePath, double prior);
+
+    bool load();
+    bool save() const;
+
+    // returns the number of productive testcases read
+    unsigned poll();
+
+    void emitted(unsigned cmpId) {
+        m_payoff[cmpId].emitted++;
+        m_emitted++;
+    }
+
+    /**
+     * Productive share of cmpId's testcases over the campaign's, in
+     * [1/4, 4]. Counts are smoothed toward the campaign rate with prior
+     * pseudo-testcases, so a target with little history weighs about 1.
+     */
+    double weight(unsigned cmpId) const;
+
+    const std::map<unsigned, TargetPayoff> &payoff() const {
+        return m_payoff;
+    }
+
+    uint64_t memoryBytes() const {
+        return m_payoff.size() * (sizeof(unsigned) + sizeof(TargetPayoff) + 4 * sizeof(void *));
+    }
+
+private:
+    std::string m_feedbackPath;
+    std::string m_statePath;
+    double m_prior;
+    uint64_t m_offset;
+    uint64_t m_emitted;
+    uint64_t m_productive;
+    std::map<unsigned, TargetPayoff> m_payoff;
+
+    static bool parseLine(const std::string &line, unsigned &cmpId);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorFeedback_H
@@ -0,0 +1,230 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#ifndef S2E_PLUGINS_TICooperatorMemory_H
+#define S2E_PLUGINS_TICooperatorMemory_H
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+class MemoryAccounting;
+
+/**
+ * Byte count of one plugin-owned container. Sizes are estimates: node based
+ * containers are charged their element size plus the allocator and tree or
+ * list links, which is what dominates for the small keys we store.
+ */
+class MemoryPool {
+public:
+    MemoryPool(MemoryAccounting *owner, const std::string &name, uint64_t limit)
+        : m_owner(owner), m_name(name), m_limit(limit), m_current(0), m_peak(0) {
+    }
+
+    void charge(int64_t bytes);
+
+    // for containers that are cheaper to measure than to track
+    void set(uint64_t bytes) {
+        charge(int64_t(bytes) - int64_t(m_current));
+    }
+
+    bool overLimit() const {
+        return m_limit && m_current > m_limit;
+    }
+
+    const std::string &name() const {
+        return m_name;
+    }
+
+    uint64_t limit() const {
+        return m_limit;
+    }
+
+    uint64_t current() const {
+        return m_current;
+    }
+
+    uint64_t peak() const {
+        return m_peak;
+    }
+
+private:
+    MemoryAccounting *m_owner;
+    std::string m_name;
+    uint64_t m_limit;
+    uint64_t m_current;
+    uint64_t m_peak;
+};
+
+class MemoryAccounting {
+public:
+    MemoryAccounting() : m_current(0), m_peak(0) {
+    }
+
+    MemoryPool *createPool(const std::string &name, uint64_t limit) {
+        m_pools.emplace_back(new MemoryPool(this, name, limit));
+        return m_pools.back().get();
+    }
+
+    const std::vector<std::unique_ptr<MemoryPool>> &pools() const {
+        return m_pools;
+    }
+
+    uint64_t current() const {
+        return m_current;
+    }
+
+    uint64_t peak() const {
+        return m_peak;
+    }
+
+private:
+    friend class MemoryPool;
+
+    std::vector<std::unique_ptr<MemoryPool>> m_pools;
+    uint64_t m_current;
+    uint64_t m_peak;
+};
+
+inline void MemoryPool::charge(int64_t bytes) {
+    m_current += bytes;
+    m_peak = std::max(m_peak, m_current);
+    m_owner->m_current += bytes;
+    m_owner->m_peak = std::max(m_owner->m_peak, m_owner->m_current);
+}
+
+// approximate footprint of a node based container
+template <typename Container> uint64_t containerBytes(const Container &c) {
+    return c.size() * (sizeof(typename Container::value_type) + 4 * sizeof(void *));
+}
+
+/**
+ * Charges a pool for the lifetime of a scope, used for per-branch temporaries
+ * so that their peak shows up even though they never outlive a callback.
+ */
+class ScopedCharge {
+public:
+    ScopedCharge(MemoryPool *pool, uint64_t bytes) : m_pool(pool), m_bytes(bytes) {
+        m_pool->charge(m_bytes);
+    }
+
+    ~ScopedCharge() {
+        m_pool->charge(-int64_t(m_bytes));
+    }
+
+private:
+    MemoryPool *m_pool;
+    uint64_t m_bytes;
+};
+
+/**
+ * Least-recently-used cache charged to a memory pool. Inserting past the
+ * pool's limit evicts from the cold end until the pool fits again.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>> class LRUCache {
+public:
+    typedef std::function<uint64_t(const K &, const V &)> SizeFunction;
+
+    LRUCache(MemoryPool *pool, SizeFunction sizeOf) : m_pool(pool), m_sizeOf(sizeOf), m_evictions(0) {
+    }
+
+    ~LRUCache() {
+        clear();
+    }
+
+    // returns nullptr on a miss, a hit becomes the most recently used entry
+    V *get(const K &key) {
+        auto it = m_index.find(key);
+        if (it == m_index.end()) {
+            return nullptr;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return &it->second->value;
+    }
+
+    void put(const K &key, const V &value) {
+        auto it = m_index.find(key);
+        if (it != m_index.end()) {
+            erase(it);
+        }
+
+        uint64_t size = m_sizeOf(key, value) + 4 * sizeof(void *);
+        m_entries.push_front(Entry{key, value, size});
+        m_index[key] = m_entries.begin();
+        m_pool->charge(size);
+
+        // never evict what was just inserted
+        while (m_pool->overLimit() && m_entries.size() > 1) {
+            erase(m_index.find(m_entries.back().key));
+            m_evictions++;
+        }
+    }
+
+    void clear() {
+        while (!m_entries.empty()) {
+            erase(m_index.find(m_entries.back().key));
+        }
+    }
+
+    size_t size() const {
+        return m_entries.size();
+    }
+
+    uint64_t evictions() const {
+        return m_evictions;
+    }
+
+private:
+    struct Entry {
+        K key;
+        V value;
+        uint64_t size;
+    };
+
+    typedef std::list<Entry> EntryList;
+    typedef std::unordered_map<K, typename EntryList::iterator, Hash, Eq> Index;
+
+    MemoryPool *m_pool;
+    SizeFunction m_sizeOf;
+    EntryList m_entries;
+    Index m_index;
+    uint64_t m_evictions;
+
+    void erase(typename Index::iterator it) {
+        m_pool->charge(-int64_t(it->second->size));
+        m_entries.erase(it->second);
+        m_index.erase(it);
+    }
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorMemory_H
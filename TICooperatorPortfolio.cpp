@@ -0,0 +1,284 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "TICooperatorPortfolio.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <poll.h>
+#include <spawn.h>
+#include <sstream>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern "C" char **environ;
+
+namespace s2e {
+namespace plugins {
+
+namespace {
+
+double now() {
+    struct timeval tv;
+    gettimeofday(&tv, nullptr);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+// posix_spawn does not copy the address space of the S2E process, and the
+// pipes are close-on-exec so that concurrent spawns do not inherit them
+pid_t spawn(const std::vector<std::string> &args, int &outFd) {
+    std::vector<char *> argv;
+    for (const auto &a : args) {
+        argv.push_back(const_cast<char *>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return -1;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    pid_t pid;
+    int err = posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+    if (err) {
+        close(fds[0]);
+        return -1;
+    }
+
+    outFd = fds[0];
+    return pid;
+}
+
+void reap(pid_t pid, int fd, bool kill) {
+    if (kill) {
+        ::kill(pid, SIGKILL);
+    }
+    close(fd);
+    while (waitpid(pid, nullptr, 0) < 0 && errno == EINTR) {
+    }
+}
+
+// first line of a solver answer
+std::string status(const std::string &output) {
+    std::istringstream is(output);
+    std::string line;
+    while (std::getline(is, line)) {
+        if (!line.empty()) {
+            return line;
+        }
+    }
+    return "";
+}
+
+// s-expression tokens: parentheses and atoms
+std::vector<std::string> tokenize(const std::string &s) {
+    std::vector<std::string> tokens;
+    size_t i = 0;
+    while (i < s.size()) {
+        char c = s[i];
+        if (c == '(' || c == ')') {
+            tokens.emplace_back(1, c);
+            i++;
+        } else if (isspace((unsigned char) c)) {
+            i++;
+        } else if (c == '|') {
+            size_t end = s.find('|', i + 1);
+            if (end == std::string::npos) {
+                end = s.size();
+            }
+            tokens.push_back(s.substr(i + 1, end - i - 1));
+            i = end + 1;
+        } else {
+            size_t start = i;
+            while (i < s.size() && s[i] != '(' && s[i] != ')' && !isspace((unsigned char) s[i])) {
+                i++;
+            }
+            tokens.push_back(s.substr(start, i - start));
+        }
+    }
+    return tokens;
+}
+
+// #xHH, #bBBBB or (_ bvN W)
+bool parseBitvector(const std::vector<std::string> &tokens, size_t &pos, uint64_t &value) {
+    if (pos >= tokens.size()) {
+        return false;
+    }
+
+    const std::string &t = tokens[pos];
+    if (t.size() > 2 && t[0] == '#' && (t[1] == 'x' || t[1] == 'b')) {
+        value = strtoull(t.c_str() + 2, nullptr, t[1] == 'x' ? 16 : 2);
+        pos++;
+        return true;
+    }
+
+    if (t == "(" && pos + 4 < tokens.size() && tokens[pos + 1] == "_" && tokens[pos + 2].compare(0, 2, "bv") == 0 &&
+        tokens[pos + 4] == ")") {
+        value = strtoull(tokens[pos + 2].c_str() + 2, nullptr, 10);
+        pos += 5;
+        return true;
+    }
+
+    return false;
+}
+
+} // namespace
+
+void SolverPortfolio::addBackend(const std::string &name, const std::string &commandLine) {
+    Backend backend;
+    backend.name = name;
+
+    std::istringstream is(commandLine);
+    std::string arg;
+    while (is >> arg) {
+        backend.argv.push_back(arg);
+    }
+
+    if (!backend.argv.empty()) {
+        m_backends.push_back(backend);
+    }
+}
+
+bool SolverPortfolio::start(const std::string &queryFile) {
+    for (size_t i = 0; i < m_backends.size(); i++) {
+        auto args = m_backends[i].argv;
+        args.push_back(queryFile);
+
+        Racer racer;
+        racer.backend = i;
+        racer.pid = spawn(args, racer.fd);
+        if (racer.pid > 0) {
+            m_racers.push_back(racer);
+        }
+    }
+    return !m_racers.empty();
+}
+
+PortfolioResult SolverPortfolio::finish(double timeout, std::string &winner, SolverModel &model) {
+    std::vector<Racer> racers;
+    racers.swap(m_racers);
+
+    PortfolioResult result = PORTFOLIO_UNKNOWN;
+    double deadline = now() + timeout;
+
+    while (!racers.empty() && result == PORTFOLIO_UNKNOWN) {
+        double left = std::max(0.0, deadline - now());
+
+        std::vector<struct pollfd> fds;
+        for (const auto &r : racers) {
+            fds.push_back({r.fd, POLLIN, 0});
+        }
+        int ready = poll(fds.data(), fds.size(), left > 0 ? int(left * 1000) + 1 : 0);
+        if (ready < 0 && errno != EINTR) {
+            break;
+        }
+        if (ready == 0 && now() >= deadline) {
+            break;
+        }
+
+        for (size_t i = 0; i < racers.size() && result == PORTFOLIO_UNKNOWN;) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                i++;
+                continue;
+            }
+
+            char buffer[4096];
+            ssize_t n = read(racers[i].fd, buffer, sizeof(buffer));
+            if (n > 0 || (n < 0 && (errno == EINTR || errno == EAGAIN))) {
+                if (n > 0) {
+                    racers[i].output.append(buffer, n);
+                }
+                i++;
+                continue;
+            }
+
+            // the backend is done, look at its answer
+            Racer done = racers[i];
+            racers.erase(racers.begin() + i);
+            fds.erase(fds.begin() + i);
+            reap(done.pid, done.fd, false);
+
+            std::string answer = status(done.output);
+            if (answer == "sat") {
+                model.clear();
+                if (parseModel(done.output, model)) {
+                    result = PORTFOLIO_SAT;
+                }
+            } else if (answer == "unsat") {
+                result = PORTFOLIO_UNSAT;
+            }
+
+            if (result != PORTFOLIO_UNKNOWN) {
+                winner = m_backends[done.backend].name;
+            }
+        }
+    }
+
+    for (auto &r : racers) {
+        reap(r.pid, r.fd, true);
+    }
+
+    return result;
+}
+
+bool SolverPortfolio::parseModel(const std::string &output, SolverModel &model) {
+    auto tokens = tokenize(output);
+
+    // ( ( select <array> <index> ) <value> )
+    for (size_t i = 0; i + 3 < tokens.size(); i++) {
+        if (tokens[i] != "(" || tokens[i + 1] != "select") {
+            continue;
+        }
+
+        std::string array = tokens[i + 2];
+        size_t pos = i + 3;
+        uint64_t index, value;
+        if (!parseBitvector(tokens, pos, index) || pos >= tokens.size() || tokens[pos] != ")") {
+            continue;
+        }
+        pos++;
+        if (!parseBitvector(tokens, pos, value)) {
+            continue;
+        }
+
+        model[array][index] = value;
+        i = pos - 1;
+    }
+
+    // sat without a single value is not an answer we can use
+    return !model.empty();
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,93 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_TICooperatorPortfolio_H
+#define S2E_PLUGINS_TICooperatorPortfolio_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+// array name -> byte index -> value
+typedef std::map<std::string, std::map<uint32_t, uint8_t>> SolverModel;
+
+enum PortfolioResult {
+    PORTFOLIO_SAT,
+    PORTFOLIO_UNSAT,
+    // every backend failed, answered unknown or ran out of time
+    PORTFOLIO_UNKNOWN,
+};
+
+/**
+ * Races external SMT-LIB solvers on one query file. Each backend is a
+ * command line that gets the file as its last argument and prints
+ * sat/unsat followed by the get-value answers. start() launches them with
+ * posix_spawn and returns right away, so the caller can run its own solver
+ * in the meantime; finish() takes the first sat or unsat and kills the
+ * other processes.
+ */
+class SolverPortfolio {
+public:
+    void addBackend(const std::string &name, const std::string &commandLine);
+
+    bool empty() const {
+        return m_backends.empty();
+    }
+
+    // false if no backend could be started
+    bool start(const std::string &queryFile);
+
+    // waits up to timeout seconds (0 only looks at what already arrived),
+    // then stops every backend still running
+    PortfolioResult finish(double timeout, std::string &winner, SolverModel &model);
+
+    // reads the ((select array index) value) pairs of a get-value answer,
+    // false if there are none
+    static bool parseModel(const std::string &output, SolverModel &model);
+
+private:
+    struct Backend {
+        std::string name;
+        std::vector<std::string> argv;
+    };
+
+    struct Racer {
+        size_t backend;
+        pid_t pid;
+        int fd;
+        std::string output;
+    };
+
+    std::vector<Backend> m_backends;
+    std::vector<Racer> m_racers;
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorPortfolio_H
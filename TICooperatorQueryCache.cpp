@@ -0,0 +1,426 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#include "TICooperatorQueryCache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+namespace {
+const uint32_t QUERY_CACHE_MAGIC = 0x43514954; // "TIQC"
+const uint32_t QUERY_CACHE_VERSION = 1;
+
+// keep the index sparse enough for short probe sequences
+const double MAX_LOAD_FACTOR = 0.7;
+
+// room for the smallest index plus some records
+const uint64_t MIN_CAPACITY = 1 << 20;
+
+struct RecordHeader {
+    uint64_t key;
+    uint32_t size;
+    uint32_t pad;
+};
+
+uint64_t align8(uint64_t v) {
+    return (v + 7) & ~7ULL;
+}
+
+uint64_t mixKey(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return key;
+}
+
+// RAII holder for the side lock file
+class FileLock {
+    int m_fd;
+
+public:
+    FileLock(int fd) : m_fd(fd) {
+        flock(m_fd, LOCK_EX);
+    }
+
+    ~FileLock() {
+        flock(m_fd, LOCK_UN);
+    }
+};
+} // namespace
+
+struct PersistentQueryCache::Header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t capacity;
+    uint64_t slotCount;
+    uint64_t dataStart;
+    std::atomic<uint64_t> dataTail;
+    std::atomic<uint64_t> entries;
+    // set once a compaction replaced this file
+    std::atomic<uint32_t> stale;
+};
+
+std::atomic<uint64_t> *PersistentQueryCache::slots(uint8_t *base) {
+    return reinterpret_cast<std::atomic<uint64_t> *>(base + align8(sizeof(Header)));
+}
+
+PersistentQueryCache::PersistentQueryCache(const std::string &path, uint64_t capacity)
+    : m_path(path), m_capacity(capacity), m_lockFd(-1), m_base(nullptr), m_mappedSize(0),
+      m_hits(0), m_lookups(0), m_compactions(0) {
+}
+
+PersistentQueryCache::~PersistentQueryCache() {
+    unmap();
+    if (m_lockFd >= 0) {
+        close(m_lockFd);
+    }
+}
+
+PersistentQueryCache::Header *PersistentQueryCache::header() const {
+    return reinterpret_cast<Header *>(m_base);
+}
+
+bool PersistentQueryCache::open() {
+    m_lockFd = ::open((m_path + ".lock").c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_lockFd < 0) {
+        return false;
+    }
+
+    FileLock lock(m_lockFd);
+    return map();
+}
+
+// Must be called with the side lock held when the file may not exist yet.
+bool PersistentQueryCache::map() {
+    int fd = ::open(m_path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    bool fresh = st.st_size == 0;
+    uint64_t size = fresh ? std::max(m_capacity, MIN_CAPACITY) : st.st_size;
+    if (fresh && ftruncate(fd, size) < 0) {
+        close(fd);
+        return false;
+    }
+
+    void *base = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    m_base = static_cast<uint8_t *>(base);
+    m_mappedSize = size;
+
+    Header *hdr = header();
+    if (fresh) {
+        // ftruncate zero-filled the file, so all slots start empty
+        uint64_t slotCount = 1024;
+        while (slotCount * 2 * 512 <= size) {
+            slotCount *= 2;
+        }
+        hdr->capacity = size;
+        hdr->slotCount = slotCount;
+        hdr->dataStart = align8(align8(sizeof(Header)) + slotCount * sizeof(uint64_t));
+        hdr->dataTail.store(hdr->dataStart);
+        hdr->entries.store(0);
+        hdr->stale.store(0);
+        hdr->version = QUERY_CACHE_VERSION;
+        hdr->magic = QUERY_CACHE_MAGIC;
+    }
+
+    if (hdr->magic != QUERY_CACHE_MAGIC || hdr->version != QUERY_CACHE_VERSION || hdr->capacity != size) {
+        unmap();
+        return false;
+    }
+
+    return true;
+}
+
+void PersistentQueryCache::unmap() {
+    if (m_base) {
+        munmap(m_base, m_mappedSize);
+        m_base = nullptr;
+        m_mappedSize = 0;
+    }
+}
+
+bool PersistentQueryCache::remapIfStale() {
+    if (!m_base) {
+        return false;
+    }
+
+    if (!header()->stale.load(std::memory_order_acquire)) {
+        return true;
+    }
+
+    // the old mapping stays valid until we drop it, the replacement file is
+    // already complete when stale is set
+    unmap();
+    return map();
+}
+
+bool PersistentQueryCache::find(uint64_t key, uint64_t &recordOffset) const {
+    Header *hdr = header();
+    std::atomic<uint64_t> *index = slots(m_base);
+    uint64_t mask = hdr->slotCount - 1;
+
+    for (uint64_t i = 0, slot = mixKey(key) & mask; i < hdr->slotCount; i++, slot = (slot + 1) & mask) {
+        uint64_t offset = index[slot].load(std::memory_order_acquire);
+        if (offset == 0) {
+            return false;
+        }
+
+        const RecordHeader *rec = reinterpret_cast<const RecordHeader *>(m_base + offset);
+        if (rec->key == key) {
+            recordOffset = offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool PersistentQueryCache::lookup(uint64_t key, QueryCacheEntry &entry) {
+    if (!remapIfStale()) {
+        return false;
+    }
+
+    m_lookups++;
+
+    uint64_t offset;
+    if (!find(key, offset)) {
+        return false;
+    }
+
+    const RecordHeader *rec = reinterpret_cast<const RecordHeader *>(m_base + offset);
+    if (!decode(m_base + offset + sizeof(RecordHeader), rec->size, entry)) {
+        return false;
+    }
+
+    m_hits++;
+    return true;
+}
+
+bool PersistentQueryCache::insert(uint64_t key, const QueryCacheEntry &entry) {
+    if (m_lockFd < 0 || !m_base) {
+        return false;
+    }
+
+    std::string payload = encode(entry);
+
+    FileLock lock(m_lockFd);
+    if (!remapIfStale()) {
+        return false;
+    }
+
+    // another seed may have solved the same query in the meantime
+    uint64_t offset;
+    if (find(key, offset)) {
+        return true;
+    }
+
+    Header *hdr = header();
+    uint64_t recordSize = align8(sizeof(RecordHeader) + payload.size());
+    if (recordSize > hdr->capacity - hdr->dataStart) {
+        return false;
+    }
+
+    bool full = hdr->dataTail.load() + recordSize > hdr->capacity;
+    bool crowded = hdr->entries.load() + 1 > hdr->slotCount * MAX_LOAD_FACTOR;
+    if (full || crowded) {
+        if (!compact()) {
+            return false;
+        }
+    }
+
+    return append(m_base, key, payload);
+}
+
+bool PersistentQueryCache::append(uint8_t *base, uint64_t key, const std::string &payload) {
+    Header *hdr = reinterpret_cast<Header *>(base);
+    uint64_t offset = hdr->dataTail.load();
+    uint64_t recordSize = align8(sizeof(RecordHeader) + payload.size());
+    if (offset + recordSize > hdr->capacity) {
+        return false;
+    }
+
+    RecordHeader *rec = reinterpret_cast<RecordHeader *>(base + offset);
+    rec->key = key;
+    rec->size = payload.size();
+    rec->pad = 0;
+    std::memcpy(base + offset + sizeof(RecordHeader), payload.data(), payload.size());
+    hdr->dataTail.store(offset + recordSize, std::memory_order_release);
+
+    // publish: readers only see the record once its slot is set
+    std::atomic<uint64_t> *index = slots(base);
+    uint64_t mask = hdr->slotCount - 1;
+    for (uint64_t i = 0, slot = mixKey(key) & mask; i < hdr->slotCount; i++, slot = (slot + 1) & mask) {
+        uint64_t expected = 0;
+        if (index[slot].compare_exchange_strong(expected, offset, std::memory_order_release)) {
+            hdr->entries.fetch_add(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Keeps the newest half of the records. Called with the side lock held.
+bool PersistentQueryCache::compact() {
+    Header *hdr = header();
+
+    std::vector<uint64_t> offsets;
+    for (uint64_t offset = hdr->dataStart; offset < hdr->dataTail.load();) {
+        const RecordHeader *rec = reinterpret_cast<const RecordHeader *>(m_base + offset);
+        offsets.push_back(offset);
+        offset += align8(sizeof(RecordHeader) + rec->size);
+    }
+
+    std::string tmpPath = m_path + ".compact";
+    unlink(tmpPath.c_str());
+
+    int fd = ::open(tmpPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    uint64_t size = hdr->capacity;
+    if (ftruncate(fd, size) < 0) {
+        close(fd);
+        return false;
+    }
+
+    void *mem = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        return false;
+    }
+
+    uint8_t *base = static_cast<uint8_t *>(mem);
+    Header *newHdr = reinterpret_cast<Header *>(base);
+    newHdr->capacity = size;
+    newHdr->slotCount = hdr->slotCount;
+    newHdr->dataStart = hdr->dataStart;
+    newHdr->dataTail.store(newHdr->dataStart);
+    newHdr->entries.store(0);
+    newHdr->stale.store(0);
+    newHdr->version = QUERY_CACHE_VERSION;
+    newHdr->magic = QUERY_CACHE_MAGIC;
+
+    for (size_t i = offsets.size() / 2; i < offsets.size(); i++) {
+        const RecordHeader *rec = reinterpret_cast<const RecordHeader *>(m_base + offsets[i]);
+        std::string payload(reinterpret_cast<const char *>(rec + 1), rec->size);
+        append(base, rec->key, payload);
+    }
+
+    msync(base, size, MS_SYNC);
+    munmap(base, size);
+
+    if (rename(tmpPath.c_str(), m_path.c_str()) < 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    hdr->stale.store(1, std::memory_order_release);
+    m_compactions++;
+
+    return remapIfStale();
+}
+
+std::string PersistentQueryCache::encode(const QueryCacheEntry &entry) {
+    std::string out;
+    auto put = [&out](const void *data, size_t size) { out.append(static_cast<const char *>(data), size); };
+
+    uint8_t sat = entry.sat;
+    uint32_t count = entry.bytes.size();
+    put(&sat, sizeof(sat));
+    put(&count, sizeof(count));
+
+    for (const auto &b : entry.bytes) {
+        uint16_t nameSize = b.array.size();
+        put(&nameSize, sizeof(nameSize));
+        put(b.array.data(), nameSize);
+        put(&b.index, sizeof(b.index));
+        put(&b.value, sizeof(b.value));
+    }
+
+    return out;
+}
+
+bool PersistentQueryCache::decode(const uint8_t *data, uint32_t size, QueryCacheEntry &entry) {
+    uint32_t pos = 0;
+    auto get = [&](void *out, size_t n) {
+        if (pos + n > size) {
+            return false;
+        }
+        std::memcpy(out, data + pos, n);
+        pos += n;
+        return true;
+    };
+
+    uint8_t sat;
+    uint32_t count;
+    if (!get(&sat, sizeof(sat)) || !get(&count, sizeof(count))) {
+        return false;
+    }
+
+    entry.sat = sat;
+    entry.bytes.clear();
+    entry.bytes.reserve(count);
+
+    for (uint32_t i = 0; i < count; i++) {
+        CachedByte b;
+        uint16_t nameSize;
+        if (!get(&nameSize, sizeof(nameSize)) || pos + nameSize > size) {
+            return false;
+        }
+        b.array.assign(reinterpret_cast<const char *>(data + pos), nameSize);
+        pos += nameSize;
+        if (!get(&b.index, sizeof(b.index)) || !get(&b.value, sizeof(b.value))) {
+            return false;
+        }
+        entry.bytes.push_back(b);
+    }
+
+    return true;
+}
+
+} // namespace plugins
+} // namespace s2e
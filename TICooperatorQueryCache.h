@@ -0,0 +1,114 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+#ifndef S2E_PLUGINS_TICooperatorQueryCache_H
+#define S2E_PLUGINS_TICooperatorQueryCache_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+// One input byte of a cached model. Arrays are matched by name, since
+// Array pointers do not survive across S2E processes.
+struct CachedByte {
+    std::string array;
+    uint32_t index;
+    uint8_t value;
+};
+
+struct QueryCacheEntry {
+    bool sat;
+    std::vector<CachedByte> bytes;
+};
+
+/**
+ * On-disk query cache shared by all S2E processes of a campaign.
+ *
+ * The file is a fixed-size memory mapping made of a header, an open
+ * addressing index and an append-only record area:
+ *
+ *   header | slot[slotCount] | record*
+ *
+ * A slot holds the offset of a record, and records are fully written before
+ * their slot is published, so lookups never take a lock. Inserts serialize on
+ * a side lock file. Once the record area or the index fills up, the inserting
+ * process rewrites the newest half of the records into a fresh file, renames
+ * it over the old one and bumps the old header's generation; other processes
+ * notice the bump on their next lookup and remap.
+ */
+class PersistentQueryCache {
+public:
+    PersistentQueryCache(const std::string &path, uint64_t capacity);
+    ~PersistentQueryCache();
+
+    bool open();
+
+    bool lookup(uint64_t key, QueryCacheEntry &entry);
+    bool insert(uint64_t key, const QueryCacheEntry &entry);
+
+    uint64_t hits() const {
+        return m_hits;
+    }
+
+    uint64_t lookups() const {
+        return m_lookups;
+    }
+
+    uint64_t compactions() const {
+        return m_compactions;
+    }
+
+private:
+    struct Header;
+
+    std::string m_path;
+    uint64_t m_capacity;
+    int m_lockFd;
+    uint8_t *m_base;
+    uint64_t m_mappedSize;
+
+    uint64_t m_hits;
+    uint64_t m_lookups;
+    uint64_t m_compactions;
+
+    Header *header() const;
+    static std::atomic<uint64_t> *slots(uint8_t *base);
+    bool map();
+    void unmap();
+    bool remapIfStale();
+
+    bool find(uint64_t key, uint64_t &recordOffset) const;
+    bool append(uint8_t *base, uint64_t key, const std::string &payload);
+    bool compact();
+
+    static std::string encode(const QueryCacheEntry &entry);
+    static bool decode(const uint8_t *data, uint32_t size, QueryCacheEntry &entry);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorQueryCache_H
@@ -0,0 +1,308 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#include "TICooperatorTestcasePipeline.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace s2e {
+namespace plugins {
+
+namespace {
+
+// writes through a temporary file next to path and renames it into place
+bool writeFileAtomic(const std::string &path, const std::vector<uint8_t> &data) {
+    // dot-prefixed, so directory scanners skip it until the rename
+    size_t slash = path.rfind('/');
+    std::string tmpPath = path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".tmp";
+
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t ret = write(fd, data.data() + done, data.size() - done);
+        if (ret <= 0) {
+            close(fd);
+            unlink(tmpPath.c_str());
+            return false;
+        }
+        done += ret;
+    }
+    close(fd);
+
+    if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool makeDirectory(const std::string &path) {
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+} // namespace
+
+///////////////////////////////////////////////////////////////////////////////
+
+bool DirectorySink::commit(const TestcaseInfo &info, const TestcaseFiles &files) {
+    char idStr[32];
+    std::snprintf(idStr, 32, "/id:%06u-%lx-%u", info.id, info.retAddr, info.cmpId);
+    std::string prefix = m_directory + idStr;
+    if (!info.tag.empty()) {
+        prefix += "-" + info.tag;
+    }
+
+    bool ok = true;
+    for (const auto &file : files) {
+        ok &= writeFileAtomic(prefix + "-" + file.first, file.second);
+    }
+    return ok;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+AFLSyncSink::AFLSyncSink(const std::string &syncDirectory, const std::string &name, const std::string &inputFile)
+    : m_instance(syncDirectory + "/" + name), m_queue(m_instance + "/queue"), m_inputFile(inputFile), m_lockFd(-1),
+      m_tmpCount(0) {
+}
+
+AFLSyncSink::~AFLSyncSink() {
+    if (m_lockFd >= 0) {
+        close(m_lockFd);
+    }
+}
+
+bool AFLSyncSink::open() {
+    size_t slash = m_instance.rfind('/');
+    if (!makeDirectory(m_instance.substr(0, slash)) || !makeDirectory(m_instance) || !makeDirectory(m_queue) ||
+        !makeDirectory(m_instance + "/.ticoop")) {
+        return false;
+    }
+
+    m_lockFd = ::open((m_instance + "/.ticoop/next_id").c_str(), O_RDWR | O_CREAT, 0644);
+    if (m_lockFd < 0) {
+        return false;
+    }
+
+    // a fresh counter continues after whatever the queue already holds
+    if (!lockCounter()) {
+        return false;
+    }
+    bool ok = true;
+    uint32_t next;
+    if (pread(m_lockFd, &next, sizeof(next), 0) != sizeof(next)) {
+        next = nextQueueId();
+        ok = pwrite(m_lockFd, &next, sizeof(next), 0) == sizeof(next);
+    }
+    ok = unlockCounter() && ok;
+    return ok;
+}
+
+bool AFLSyncSink::lockCounter() {
+    int ret;
+    while ((ret = flock(m_lockFd, LOCK_EX)) < 0 && errno == EINTR) {
+    }
+    return ret == 0;
+}
+
+bool AFLSyncSink::unlockCounter() {
+    return flock(m_lockFd, LOCK_UN) == 0;
+}
+
+bool AFLSyncSink::commit(const TestcaseInfo &info, const TestcaseFiles &files) {
+    // AFL inputs are a single file
+    auto input = files.end();
+    if (!m_inputFile.empty()) {
+        input = files.find(m_inputFile);
+    } else if (files.size() == 1) {
+        input = files.begin();
+    }
+    if (input == files.end()) {
+        return false;
+    }
+
+    char tmpName[64];
+    std::snprintf(tmpName, sizeof(tmpName), "/.ticoop/tmp-%d-%u", getpid(), m_tmpCount++);
+    std::string tmpPath = m_instance + tmpName;
+    if (!writeFileAtomic(tmpPath, input->second)) {
+        return false;
+    }
+
+    if (!lockCounter()) {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    uint32_t id = 0;
+    bool ok = pread(m_lockFd, &id, sizeof(id), 0) == sizeof(id);
+
+    char name[128];
+    std::snprintf(name, sizeof(name), "/id:%06u,src:ticoop,ret:%lx,cmp:%u", id, info.retAddr, info.cmpId);
+    std::string path = m_queue + name;
+    if (!info.tag.empty()) {
+        path += "," + info.tag;
+    }
+
+    ok = ok && rename(tmpPath.c_str(), path.c_str()) == 0;
+    if (ok) {
+        id++;
+        ok = pwrite(m_lockFd, &id, sizeof(id), 0) == sizeof(id);
+    }
+
+    ok = unlockCounter() && ok;
+
+    if (!ok) {
+        unlink(tmpPath.c_str());
+    }
+    return ok;
+}
+
+uint32_t AFLSyncSink::nextQueueId() const {
+    uint32_t next = 0;
+    DIR *dir = opendir(m_queue.c_str());
+    if (!dir) {
+        return next;
+    }
+
+    while (struct dirent *entry = readdir(dir)) {
+        unsigned id;
+        if (std::sscanf(entry->d_name, "id:%u", &id) == 1) {
+            next = std::max(next, id + 1);
+        }
+    }
+    closedir(dir);
+    return next;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+
+TestcasePipeline::TestcasePipeline(TestcaseSink *sink, unsigned threads, unsigned queueSize)
+    : m_sink(sink), m_jobs(queueSize), m_assembled(queueSize), m_drained(false), m_submitted(0),
+      m_written(0), m_duplicates(0), m_failed(0), m_queuedBytes(0) {
+    for (unsigned i = 0; i < std::max(1u, threads); i++) {
+        m_assemblers.emplace_back(&TestcasePipeline::assembleLoop, this);
+    }
+    m_writer = std::thread(&TestcasePipeline::writeLoop, this);
+}
+
+TestcasePipeline::~TestcasePipeline() {
+    drain();
+}
+
+void TestcasePipeline::submit(TestcaseJob job) {
+    m_submitted++;
+    m_queuedBytes += job.bytes;
+    m_jobs.push(std::move(job));
+}
+
+uint64_t TestcasePipeline::memoryBytes() {
+    std::lock_guard<std::mutex> lock(m_hashMutex);
+    return m_queuedBytes + m_hashes.size() * (sizeof(uint64_t) + 4 * sizeof(void *));
+}
+
+void TestcasePipeline::drain() {
+    if (m_drained) {
+        return;
+    }
+    m_drained = true;
+
+    m_jobs.close();
+    for (auto &t : m_assemblers) {
+        t.join();
+    }
+
+    m_assembled.close();
+    m_writer.join();
+}
+
+void TestcasePipeline::assembleLoop() {
+    TestcaseJob job;
+    while (m_jobs.pop(job)) {
+        AssembledTestcase testcase;
+        testcase.info = job.info;
+        job.assemble(testcase.files);
+
+        // the job's model and templates are released, its files take their place
+        testcase.bytes = 0;
+        for (const auto &file : testcase.files) {
+            testcase.bytes += file.first.size() + file.second.size();
+        }
+        m_queuedBytes -= job.bytes;
+        job = TestcaseJob();
+
+        uint64_t hash = hashTestcase(testcase.files);
+        {
+            std::lock_guard<std::mutex> lock(m_hashMutex);
+            if (!m_hashes.insert(hash).second) {
+                m_duplicates++;
+                continue;
+            }
+        }
+
+        m_queuedBytes += testcase.bytes;
+
+        m_assembled.push(std::move(testcase));
+    }
+}
+
+void TestcasePipeline::writeLoop() {
+    AssembledTestcase testcase;
+    while (m_assembled.pop(testcase)) {
+        if (m_sink->commit(testcase.info, testcase.files)) {
+            m_written++;
+        } else {
+            m_failed++;
+        }
+        m_queuedBytes -= testcase.bytes;
+    }
+}
+
+// FNV-1a over file names and contents
+uint64_t TestcasePipeline::hashTestcase(const TestcaseFiles &files) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    auto mix = [&hash](const uint8_t *data, size_t size) {
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 0x100000001b3ULL;
+        }
+    };
+
+    for (const auto &file : files) {
+        mix(reinterpret_cast<const uint8_t *>(file.first.data()), file.first.size() + 1);
+        mix(file.second.data(), file.second.size());
+    }
+    return hash;
+}
+
+} // namespace plugins
+} // namespace s2e
@@ -0,0 +1,263 @@
+///
+/// Copyright (C) 2022, tl455047
+///
+/// Permission is hereby granted, free of charge, to any person obtaining a copy
+/// of this software and associated documentation files (the "Software"), to deal
+/// in the Software without restriction, including without limitation the rights
+/// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+/// copies of the Software, and to permit persons to whom the Software is
+/// furnished to do so, subject to the following conditions:
+///
+/// The above copyright notice and this permission notice shall be included in all
+/// copies or substantial portions of the Software.
+///
+/// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+/// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+/// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+/// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+/// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+/// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+/// SOFTWARE.
+///
+
+
+#ifndef S2E_PLUGINS_TICooperatorTestcasePipeline_H
+#define S2E_PLUGINS_TICooperatorTestcasePipeline_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace s2e {
+namespace plugins {
+
+// file name -> contents of one testcase
+typedef std::map<std::string, std::vector<uint8_t>> TestcaseFiles;
+
+// what a testcase was solved for, encoded into its file names by the sink
+struct TestcaseInfo {
+    unsigned id;
+    uint64_t retAddr;
+    unsigned cmpId;
+    std::string tag;
+};
+
+/**
+ * A solved branch waiting to become files. The assemble function runs on a
+ * pipeline thread, so it must only touch data it owns (the model and a copy
+ * of the file templates), never the execution state.
+ */
+struct TestcaseJob {
+    TestcaseInfo info;
+    std::function<void(TestcaseFiles &)> assemble;
+    // what assemble holds on to (model, templates), for memory accounting
+    uint64_t bytes;
+};
+
+// Where the pipeline's writer commits testcases. Only the writer thread calls commit.
+class TestcaseSink {
+public:
+    virtual ~TestcaseSink() {
+    }
+
+    virtual bool commit(const TestcaseInfo &info, const TestcaseFiles &files) = 0;
+};
+
+// S2E output layout: <directory>/id:NNNNNN-<ret_addr>-<cmpId>[-tag]-<file>
+class DirectorySink : public TestcaseSink {
+public:
+    DirectorySink(const std::string &directory) : m_directory(directory) {
+    }
+
+    bool commit(const TestcaseInfo &info, const TestcaseFiles &files);
+
+private:
+    std::string m_directory;
+};
+
+/**
+ * AFL sync directory layout: <sync>/<name>/queue/id:NNNNNN,src:ticoop,...
+ *
+ * AFL picks up foreign testcases by id, remembering the last id it synced,
+ * so ids must grow in the order files appear, across every S2E instance
+ * writing under the same name. The next id lives in a lock file; a testcase
+ * is written to a private temporary file first, and only the id allocation
+ * and the rename into queue/ happen under the lock.
+ */
+class AFLSyncSink : public TestcaseSink {
+public:
+    AFLSyncSink(const std::string &syncDirectory, const std::string &name, const std::string &inputFile);
+    ~AFLSyncSink();
+
+    // creates the directories and the id counter, false on failure
+    bool open();
+
+    bool commit(const TestcaseInfo &info, const TestcaseFiles &files);
+
+    const std::string &queueDirectory() const {
+        return m_queue;
+    }
+
+private:
+    std::string m_instance;
+    std::string m_queue;
+    std::string m_inputFile;
+    int m_lockFd;
+    unsigned m_tmpCount;
+
+    uint32_t nextQueueId() const;
+    // exclusive lock on the shared id counter
+    bool lockCounter();
+    bool unlockCounter();
+};
+
+/**
+ * Blocking FIFO with a fixed capacity. A full queue makes producers wait,
+ * which is the pipeline's backpressure; each wait is counted.
+ */
+template <typename T> class BoundedQueue {
+public:
+    BoundedQueue(size_t capacity) : m_capacity(capacity), m_closed(false), m_stalls(0), m_peak(0) {
+    }
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_items.size() >= m_capacity) {
+            m_stalls++;
+            m_notFull.wait(lock, [this] { return m_items.size() < m_capacity; });
+        }
+        m_items.push_back(std::move(item));
+        m_peak = std::max<uint64_t>(m_peak, m_items.size());
+        m_notEmpty.notify_one();
+    }
+
+    // false once the queue is closed and empty
+    bool pop(T &item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty()) {
+            return false;
+        }
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_notEmpty.notify_all();
+    }
+
+    uint64_t stalls() const {
+        return m_stalls;
+    }
+
+    uint64_t peak() const {
+        return m_peak;
+    }
+
+private:
+    size_t m_capacity;
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    bool m_closed;
+    std::atomic<uint64_t> m_stalls;
+    std::atomic<uint64_t> m_peak;
+};
+
+/**
+ * Moves testcase assembly and writing off the emulation thread:
+ *
+ *   submit -> [jobs] -> assembler threads -> [assembled] -> writer thread
+ *
+ * Assemblers merge the model into the file templates and hash the result,
+ * dropping testcases identical to one already written. A single writer
+ * hands them to the sink, which writes under a temporary name and renames
+ * into place, so a fuzzer watching the directory never reads a partial
+ * testcase.
+ */
+class TestcasePipeline {
+public:
+    // takes ownership of the sink
+    TestcasePipeline(TestcaseSink *sink, unsigned threads, unsigned queueSize);
+    ~TestcasePipeline();
+
+    // blocks while the job queue is full
+    void submit(TestcaseJob job);
+
+    // waits until every submitted testcase is written, then stops the threads
+    void drain();
+
+    uint64_t submitted() const {
+        return m_submitted;
+    }
+
+    uint64_t written() const {
+        return m_written;
+    }
+
+    uint64_t duplicates() const {
+        return m_duplicates;
+    }
+
+    uint64_t failed() const {
+        return m_failed;
+    }
+
+    // producer waits on a full job queue / assembler waits on the writer
+    uint64_t submitStalls() const {
+        return m_jobs.stalls();
+    }
+
+    uint64_t writeStalls() const {
+        return m_assembled.stalls();
+    }
+
+    // queued jobs and testcases plus the duplicate filter
+    uint64_t memoryBytes();
+
+private:
+    struct AssembledTestcase {
+        TestcaseInfo info;
+        TestcaseFiles files;
+        uint64_t bytes;
+    };
+
+    std::unique_ptr<TestcaseSink> m_sink;
+    BoundedQueue<TestcaseJob> m_jobs;
+    BoundedQueue<AssembledTestcase> m_assembled;
+    std::vector<std::thread> m_assemblers;
+    std::thread m_writer;
+    bool m_drained;
+
+    std::mutex m_hashMutex;
+    std::unordered_set<uint64_t> m_hashes;
+
+    std::atomic<uint64_t> m_submitted;
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_duplicates;
+    std::atomic<uint64_t> m_failed;
+    std::atomic<uint64_t> m_queuedBytes;
+
+    void assembleLoop();
+    void writeLoop();
+    static uint64_t hashTestcase(const TestcaseFiles &files);
+};
+
+} // namespace plugins
+} // namespace s2e
+
+#endif // S2E_PLUGINS_TICooperatorTestcasePipeline_H
@@ -0,0 +1,121 @@
+//
+// Copyright (C) 2022, tl455047
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+
+// Guest-side control of the TICooperator plugin, in the style of s2ecmd.
+//
+//   ticoopcmd stats
+//   ticoopcmd timeout <seconds>
+//   ticoopcmd budget solutions|jumps|minimize <value>
+//   ticoopcmd disable <start> <end>
+//   ticoopcmd enable <start> <end>
+//   ticoopcmd begin | end
+//   ticoopcmd counters
+//
+// Build against the S2E guest headers:
+//   gcc -I<s2e>/guest/common/include -I.. -o ticoopcmd ticoopcmd.c
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <s2e/s2e.h>
+
+#include "TICooperatorCommands.h"
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "usage: %s stats | timeout <seconds> | budget solutions|jumps|minimize <value> |\n"
+            "       disable <start> <end> | enable <start> <end> | begin | end | counters\n",
+            prog);
+    exit(1);
+}
+
+static uint64_t number(const char *s) {
+    return strtoull(s, NULL, 0);
+}
+
+static int invoke(S2E_TICooperator_COMMAND *command) {
+    return s2e_invoke_plugin("TICooperator", command, sizeof(*command));
+}
+
+int main(int argc, char **argv) {
+    S2E_TICooperator_COMMAND command;
+    memset(&command, 0, sizeof(command));
+    command.Version = TICOOP_COMMAND_VERSION;
+
+    if (argc < 2) {
+        usage(argv[0]);
+    }
+
+    const char *cmd = argv[1];
+    if (!strcmp(cmd, "stats") && argc == 2) {
+        command.Command = TICOOP_PRINT_STATISTICS;
+    } else if (!strcmp(cmd, "timeout") && argc == 3) {
+        command.Command = TICOOP_SET_TIMEOUT;
+        command.Timeout = number(argv[2]);
+    } else if (!strcmp(cmd, "budget") && argc == 4) {
+        command.Command = TICOOP_SET_BUDGET;
+        if (!strcmp(argv[2], "solutions")) {
+            command.Budget.Kind = TICOOP_BUDGET_SOLUTIONS;
+        } else if (!strcmp(argv[2], "jumps")) {
+            command.Budget.Kind = TICOOP_BUDGET_JUMP_TARGETS;
+        } else if (!strcmp(argv[2], "minimize")) {
+            command.Budget.Kind = TICOOP_BUDGET_MINIMIZE;
+        } else {
+            usage(argv[0]);
+        }
+        command.Budget.Value = number(argv[3]);
+    } else if ((!strcmp(cmd, "disable") || !strcmp(cmd, "enable")) && argc == 4) {
+        command.Command = !strcmp(cmd, "disable") ? TICOOP_DISABLE_REGION : TICOOP_ENABLE_REGION;
+        command.Region.Start = number(argv[2]);
+        command.Region.End = number(argv[3]);
+    } else if (!strcmp(cmd, "begin") && argc == 2) {
+        command.Command = TICOOP_PHASE_BEGIN;
+    } else if (!strcmp(cmd, "end") && argc == 2) {
+        command.Command = TICOOP_PHASE_END;
+    } else if (!strcmp(cmd, "counters") && argc == 2) {
+        S2E_TICooperator_COUNTERS counters;
+        memset(&counters, 0, sizeof(counters));
+        command.Command = TICOOP_GET_COUNTERS;
+        command.Counters.Buffer = (uintptr_t) &counters;
+        command.Counters.Size = sizeof(counters);
+        if (invoke(&command) < 0) {
+            fprintf(stderr, "TICooperator is not enabled\n");
+            return 1;
+        }
+        printf("constraints %" PRIu64 "\nsolved %" PRIu64 "\nunsolved %" PRIu64 "\ntargets %" PRIu64
+               "\nstepped %" PRIu64 "\ntestcases %" PRIu64 "\nsolver_us %" PRIu64 "\nin_phase %" PRIu64 "\n",
+               counters.Constraints, counters.Solved, counters.Unsolved, counters.Targets, counters.Stepped,
+               counters.Testcases, counters.SolverMicroseconds, counters.InPhase);
+        return 0;
+    } else {
+        usage(argv[0]);
+    }
+
+    if (invoke(&command) < 0) {
+        fprintf(stderr, "TICooperator is not enabled\n");
+        return 1;
+    }
+    return 0;
+}
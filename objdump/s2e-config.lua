@@ -381,5 +381,195 @@ end
 --]]
 add_plugin("TICooperator")
 pluginsConfig.TICooperator = {
-  
+  -- Snapshot plugin state every checkpointInterval seconds (0 disables it).
+  -- With resume = true, targets recorded in the snapshot are not solved again,
+  -- and its solution counts, jump targets and dictionary tokens carry over.
+  checkpointFile = "ticoop.ckpt",
+  checkpointInterval = 0,
+  resume = false,
+
+  -- Memory-mapped query cache shared by all S2E instances of a campaign.
+  -- Empty disables it. queryCacheSize is in MB. Hits, lookups and solver
+  -- seconds saved are sampled to querycache.stats.
+  queryCacheFile = "",
+  queryCacheSize = 256,
+
+  -- Per-pool memory caps in MB (0 is unlimited). Caches evict in LRU order
+  -- when over their cap; the target sets, dictionary, edge map, feedback and
+  -- testcase pipeline are only reported.
+  memoryLimits = {
+    targets = 0,
+    temporaries = 0,
+    dictionary = 0,
+    edgeMap = 0,
+    feedback = 0,
+    pipeline = 0,
+    symbolicBytes = 64,
+    addressBounds = 16,
+    unsatCores = 16,
+  },
+
+  -- Symbolic memory addresses: "none" (ignored), "concolic" (concretize to
+  -- the seed's address), "symbolic" (leave them to the engine) or "range"
+  -- (concretize only ranges wider than symbolicAddressMaxRange). Boundary
+  -- testcases are tagged "oob" when further than symbolicAddressWindow away.
+  symbolicAddressPolicy = "none",
+  symbolicAddressMaxRange = 0x100,
+  symbolicAddressWindow = 0x1000,
+  symbolicAddressTestcases = true,
+
+  -- Enumerate up to this many feasible targets of each symbolic jump site
+  -- (jump tables), counting the ones it actually jumped to, and emit one
+  -- testcase per new target. 0 disables it.
+  jumpTargetBudget = 0,
+
+  -- Addresses of comparison functions (or their PLT stubs) in the target.
+  -- Calls to them whose return address is a TI target are solved as one
+  -- equality query, and their constant operands go to ticoop.dict.
+  comparisonModels = {
+    memcmp = {},
+    strcmp = {},
+    strncmp = {},
+  },
+  maxComparisonLength = 256,
+
+  -- Testcases per solved target. Extra ones cover the boundaries of the
+  -- compared value first, then any model that differs on the compared bytes.
+  solutionsPerTarget = 1,
+
+  -- Replay the path and the flipped condition under each model before
+  -- writing it: "off", "tag" (suffix -diverged) or "drop". Only the path
+  -- constraints reading bytes the model changed are replayed. A model that
+  -- misses the flipped condition itself is dropped under any policy, it
+  -- would not reach the target.
+  divergenceCheck = "off",
+
+  -- Remember the constraints that made a branch query unsat and answer
+  -- later queries containing them without the solver. Slices of at most
+  -- unsatCoreMinimize constraints are shrunk further by deletion.
+  unsatCores = false,
+  unsatCoreMinimize = 16,
+
+  -- Conditions on a single input byte (equalities and ranges) are solved by
+  -- trying byte values against the path instead of calling the solver.
+  -- Per-shape counts and times go to shapes.stats.
+  shapeRouting = true,
+
+  -- File of "<marker pc> [<ret_addr> ...]" lines listing the targets still
+  -- reachable from each marker. Reaching a marker whose targets are all
+  -- stepped ends the state; cutoff.stats records where. Empty disables.
+  cutoffMarkers = "",
+
+  -- Predict solve time from the query slice (constraints, nodes, bytes,
+  -- mul/div/shift) and dump queries predicted over costBudget seconds to
+  -- deferred/ as kquery files instead of solving them. The model starts
+  -- predicting after costWarmup queries and still solves every
+  -- costExplore-th deferred query to keep learning. cost.stats logs
+  -- predicted vs actual times. 0 disables.
+  costBudget = 0,
+  costWarmup = 32,
+  costExplore = 16,
+
+  -- Assemble and write testcases on this many threads instead of the
+  -- emulation thread, with bounded queues of testcaseQueueSize. Identical
+  -- testcases are written once. 0 keeps writing through TestCaseGenerator.
+  testcaseThreads = 0,
+  testcaseQueueSize = 64,
+
+  -- Write testcases into an AFL sync directory instead, as
+  -- <syncDirectory>/<syncName>/queue/id:NNNNNN,src:ticoop,ret:...,cmp:...
+  -- Instances sharing a syncName share monotonic ids. syncInput is the
+  -- symbolic file to emit when testcases have several. Uses the pipeline
+  -- with at least one thread. Empty disables.
+  syncDirectory = "",
+  syncName = "ticoop",
+  syncInput = "",
+
+  -- Seconds of wall time between stats samples (Solving.stats and
+  -- timing.stats: wall, user, system, RSS, solver time); 0 samples on
+  -- every timer tick.
+  statsInterval = 0,
+
+  -- Terminate after timeout seconds of "user", "cpu" (user + system) or
+  -- "wall" time, checked on every timer tick.
+  timeout = 3600000,
+  timeoutClock = "user",
+
+  -- Attribute query time to the input bytes each query reads and write
+  -- heatmap.stats (array, offset, queries, seconds, shared seconds) on
+  -- every stats sample and at shutdown.
+  heatmap = false,
+
+  -- Reset solved bytes back to the seed wherever the flipped condition and
+  -- its slice still hold, so testcases differ from the seed only where
+  -- needed, for every solved testcase (diverse solutions and modeled
+  -- comparisons included). minimizeBudget caps the bytes tried per model
+  -- (0 unlimited).
+  minimizeTestcases = false,
+  minimizeBudget = 0,
+
+  -- Only evaluate targets inside the input-processing phase. The phase is
+  -- entered at any phaseBegin pc and left at any phaseEnd pc, or marked by
+  -- the guest with "ticoopcmd begin" / "ticoopcmd end". Phases are logged
+  -- to phases.stats either way.
+  scopeToPhase = false,
+  phaseBegin = {},
+  phaseEnd = {},
+
+  -- File of "<ret_addr> <array> <offset> ..." lines from TI listing the
+  -- bytes of each symbolic object (by array name) a target depends on.
+  -- Other bytes, and bytes whose targets are
+  -- all stepped, are pinned to their concolic value when a fork condition
+  -- first reads them (concretized.stats). Empty disables.
+  criticalBytes = "",
+
+  -- Node and depth limits of a branch query's expressions (0 unlimited).
+  -- Over-limit queries fall back to "optimistic" (solve the flipped
+  -- condition alone), "concretize" (replace the offending subtrees by
+  -- their concolic values) or "dump" (kquery in deferred/). budget.stats
+  -- counts fallbacks per target.
+  maxQueryNodes = 0,
+  maxQueryDepth = 0,
+  queryBudgetFallback = "optimistic",
+
+  -- External solvers raced on every solver query, printed as SMT-LIB to a
+  -- temporary portfolio-*.smt2. Each command gets the file as last argument;
+  -- they run alongside S2E's solver, whose model ends the race. Without one,
+  -- the backends get up to portfolioTimeout more seconds (0 takes only the
+  -- answers already in). portfolio.stats counts wins per shape.
+  portfolio = {
+    -- z3 = "z3 -smt2",
+    -- boolector = "boolector --smt2 -m",
+    -- stp = "stp --SMTLIB2",
+  },
+  portfolioTimeout = 0,
+
+  -- Hold fork-decide queries in a trie keyed by their path prefix and
+  -- solve them in one walk every batchInterval seconds, after batchSize
+  -- queries (0 no limit) and when the state is killed. Prefix constraints
+  -- are sliced once per walk instead of once per query (batch.stats); each
+  -- query is still solved on its own, under the prefix and concolic values
+  -- it was raised with.
+  batchSolving = false,
+  batchSize = 0,
+  batchInterval = 5,
+
+  -- AFL edge bitmap of the concolic path through [edgeStart, edgeEnd),
+  -- written to edges.bitmap when the state is killed and, with a SysV shm
+  -- id in edgeBitmapShm (-1 none), copied into the fuzzer's segment.
+  edgeBitmap = false,
+  edgeMapSize = 65536,
+  edgeStart = 0x400000,
+  edgeEnd = 0x800000,
+  edgeBitmapShm = -1,
+
+  -- File the fuzzer appends the names of productive TICooperator testcases
+  -- to (empty disables), polled every feedbackInterval seconds. Targets
+  -- whose flips pay off get more solutions and solver time, the others are
+  -- solved less often. Counts persist in feedbackState across launches and
+  -- are saved with every checkpoint (checkpointInterval); feedbackPrior is how many testcases it takes to move a target's weight.
+  feedbackFile = "",
+  feedbackState = "ticoop.feedback",
+  feedbackInterval = 10,
+  feedbackPrior = 8,
 }
\ No newline at end of file